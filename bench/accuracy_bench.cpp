@@ -0,0 +1,236 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+#include <boost/math/distributions/normal.hpp>
+
+#include "../expression.hpp"
+
+/**
+ * Accuracy versus cost of the engine (`make accuracy`): expressions with
+ * closed-form results (sums of normals, Irwin-Hall sums of uniforms,
+ * scaled uniforms and the product of uniforms) are evaluated with several
+ * bin sizes and compared with the exact distribution.
+ *
+ * Bin i of the result (value x) stands for the interval
+ * [x - bin_size / 2, x + bin_size / 2], its exact probability is the
+ * difference of the exact CDF at the edges. Errors:
+ *   L1       - sum of |probability - exact probability| (with the exact
+ *              probability outside the result)
+ *   KS       - maximum |CDF - exact CDF| at the edges of the bins
+ *   mean err - |mean - exact mean|
+ *   var err  - |variance - exact variance| / exact variance
+ * Time is the mean wall time of the parsing and evaluation, repeated until
+ * it ran at least ACCURACY_MIN_SECONDS. Rows marked * in the pareto column
+ * are not dominated by another bin size of the same case (no other one is
+ * both faster and has a smaller KS).
+ *
+ * Normal operands use the quotient ACCURACY_QUOTIENT (ranges of +-6 standard
+ * deviations), so the truncation of the ranges is negligible.
+ *
+ * Usage: accuracy_bench [case_name]
+ */
+
+#define ACCURACY_MIN_SECONDS 0.1
+#define ACCURACY_QUOTIENT 6
+
+using real = double;
+
+/**
+ * Expression with a known result.
+ */
+struct Accuracy_case{
+    std::string name;
+    std::string expression;
+    double mean;
+    double variance;
+    std::function<double(double)> cdf; // exact CDF of the result
+    std::vector<double> bin_sizes;
+};
+
+/**
+ * Errors and cost of one evaluation.
+ */
+struct Accuracy_result{
+    double bin_size;
+    size_t bins;
+    double seconds;
+    double l1;
+    double ks;
+    double mean_error;
+    double variance_error;
+};
+
+/**
+ * CDF of the sum of n uniform distributions on [0, 1] (Irwin-Hall).
+ */
+double irwin_hall_cdf(int n, double x){
+    if(x <= 0) return 0;
+    if(x >= n) return 1;
+    double sum = 0;
+    double binomial = 1; // n over k
+    double factorial = 1; // n!
+    for(int k = 1; k <= n; k++) factorial *= k;
+    for(int k = 0; k <= std::floor(x); k++){
+        sum += (k % 2 == 0 ? 1 : -1) * binomial * std::pow(x - k, n);
+        binomial = binomial * (n - k) / (k + 1);
+    }
+    return sum / factorial;
+}
+
+double uniform_cdf(double from, double to, double x){
+    return std::min(1.0, std::max(0.0, (x - from) / (to - from)));
+}
+
+std::vector<Accuracy_case> accuracy_cases(){
+    std::vector<Accuracy_case> cases;
+
+    // N(6, 1) + N(12, 2) = N(18, 5)
+    boost::math::normal_distribution<double> normal_sum(18, std::sqrt(5.0));
+    cases.push_back({"normal+normal", "0 ~ 12 + 0 ~ 24", 18, 5,
+                     [normal_sum](double x){ return boost::math::cdf(normal_sum, x); },
+                     {1, 0.5, 0.2, 0.1, 0.05, 0.02}});
+
+    // N(6, 1) * 2 + N(6, 1) = N(18, 5)
+    cases.push_back({"2*normal+normal", "0 ~ 12 * 2 + 0 ~ 12", 18, 5,
+                     [normal_sum](double x){ return boost::math::cdf(normal_sum, x); },
+                     {1, 0.5, 0.2, 0.1, 0.05, 0.02}});
+
+    // Irwin-Hall: sum of n U(0, 1), mean n/2, variance n/12
+    std::string sum = "0 u 1";
+    for(int n = 2; n <= 4; n++){
+        sum += " + 0 u 1";
+        cases.push_back({"irwin-hall " + std::to_string(n), sum, n / 2.0, n / 12.0,
+                         [n](double x){ return irwin_hall_cdf(n, x); },
+                         {0.1, 0.05, 0.02, 0.01, 0.005, 0.002}});
+    }
+
+    // scaled uniforms: U(0, 1) * 3 = U(0, 3), U(0, 4) / 4 = U(0, 1)
+    cases.push_back({"uniform*3", "(0 u 1) * 3", 1.5, 9 / 12.0,
+                     [](double x){ return uniform_cdf(0, 3, x); },
+                     {0.1, 0.05, 0.02, 0.01, 0.005, 0.002}});
+    cases.push_back({"uniform/4", "(0 u 4) / 4", 0.5, 1 / 12.0,
+                     [](double x){ return uniform_cdf(0, 1, x); },
+                     {0.1, 0.05, 0.02, 0.01, 0.005, 0.002}});
+
+    // product of U(0, 1) and U(0, 1): CDF z - z ln z, mean 1/4, variance 1/9 - 1/16
+    cases.push_back({"uniform*uniform", "0 u 1 * 0 u 1", 0.25, 1 / 9.0 - 1 / 16.0,
+                     [](double x){ return x <= 0 ? 0 : x >= 1 ? 1 : x - x * std::log(x); },
+                     {0.1, 0.05, 0.02, 0.01, 0.005, 0.002}});
+    return cases;
+}
+
+/**
+ * Evaluates the expression. Returns bool (success), the bins of the result
+ * are saved.
+ */
+bool evaluate(const std::string& text, double bin_size, std::vector<real>& bins, real& origin, real& width){
+    Expression<real> expression(bin_size, ACCURACY_QUOTIENT);
+    std::stringstream input(text);
+    if(!expression.parse_input(input, false) || !expression.evaluate(-1)) return false;
+    const Token<real>* result = expression.result();
+    if(result == nullptr || result->get_is_number()) return false;
+
+    const Distribution<real>* distribution = result->get_distribution();
+    distribution->to_bins(bins);
+    origin = distribution->get_from();
+    width = distribution->get_bin_size();
+    return true;
+}
+
+/**
+ * Evaluates the case with the bin size and compares it with the exact result.
+ * Returns bool (success)
+ */
+bool measure(const Accuracy_case& test, double bin_size, Accuracy_result& result){
+    std::vector<real> bins;
+    real origin, width;
+
+    int repetitions = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    while(seconds < ACCURACY_MIN_SECONDS || repetitions == 0){
+        if(!evaluate(test.expression, bin_size, bins, origin, width)) return false;
+        repetitions++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    result.bin_size = bin_size;
+    result.bins = bins.size();
+    result.seconds = seconds / repetitions;
+
+    // mass outside the bins
+    double lower = origin - width / 2;
+    double exact_cdf = test.cdf(lower);
+    double l1 = exact_cdf;
+    double ks = exact_cdf;
+    double cdf = 0;
+    double mean = 0;
+    for(size_t i = 0; i < bins.size(); i++){
+        double value = origin + i * width;
+        double exact_next = test.cdf(value + width / 2);
+        l1 += std::abs(bins[i] - (exact_next - exact_cdf));
+        cdf += bins[i];
+        ks = std::max(ks, std::abs(cdf - exact_next));
+        mean += value * bins[i];
+        exact_cdf = exact_next;
+    }
+    l1 += 1 - exact_cdf;
+
+    double variance = 0;
+    for(size_t i = 0; i < bins.size(); i++){
+        double value = origin + i * width;
+        variance += (value - mean) * (value - mean) * bins[i];
+    }
+
+    result.l1 = l1;
+    result.ks = ks;
+    result.mean_error = std::abs(mean - test.mean);
+    result.variance_error = std::abs(variance - test.variance) / test.variance;
+    return true;
+}
+
+int main(int argc, char **argv){
+    std::string only = argc > 1 ? argv[1] : "";
+
+    std::cout << std::left << std::setw(18) << "case" << std::right << std::setw(10) << "bin_size"
+              << std::setw(9) << "bins" << std::setw(12) << "time [ms]" << std::setw(11) << "L1"
+              << std::setw(11) << "KS" << std::setw(11) << "mean err" << std::setw(11) << "var err"
+              << "  pareto" << std::endl;
+
+    bool failed = false;
+    for(auto&& test : accuracy_cases()){
+        if(!only.empty() && test.name != only) continue;
+
+        std::vector<Accuracy_result> results;
+        for(double bin_size : test.bin_sizes){
+            Accuracy_result result;
+            if(!measure(test, bin_size, result)){
+                std::cerr << "ERROR: CASE " << test.name << " FAILED WITH BIN SIZE " << bin_size << std::endl;
+                failed = true;
+                continue;
+            }
+            results.push_back(result);
+        }
+
+        for(auto&& result : results){
+            bool dominated = false;
+            for(auto&& other : results){
+                if(other.seconds <= result.seconds && other.ks <= result.ks &&
+                   (other.seconds < result.seconds || other.ks < result.ks)) dominated = true;
+            }
+
+            std::cout << std::left << std::setw(18) << test.name << std::right << std::setw(10) << result.bin_size
+                      << std::setw(9) << result.bins << std::fixed << std::setprecision(3)
+                      << std::setw(12) << result.seconds * 1e3 << std::scientific << std::setprecision(2)
+                      << std::setw(11) << result.l1 << std::setw(11) << result.ks
+                      << std::setw(11) << result.mean_error << std::setw(11) << result.variance_error
+                      << std::defaultfloat << std::setprecision(6) << "  " << (dominated ? "" : "*") << std::endl;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+#ifndef BENCH_CORPUS_HPP_
+#define BENCH_CORPUS_HPP_
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Corpus of the harnesses in bench/ (perf_regression, worst_case_fuzzer):
+ * one case per line, `name<TAB>arguments<TAB>input`, `\n` in the input
+ * is a new line, lines starting with # are comments.
+ */
+
+struct Perf_case{
+    std::string name;
+    std::vector<std::string> arguments;
+    std::string input;
+};
+
+/**
+ * Reads the corpus. Returns bool (success)
+ */
+bool read_corpus(const char* path, std::vector<Perf_case>& cases){
+    std::ifstream file(path);
+    if(!file.is_open()) return false;
+
+    std::string line;
+    while(std::getline(file, line)){
+        if(line.empty() || line[0] == '#') continue;
+        size_t first = line.find('\t');
+        size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+        if(second == std::string::npos) return false;
+
+        Perf_case test;
+        test.name = line.substr(0, first);
+        std::stringstream arguments(line.substr(first + 1, second - first - 1));
+        std::string argument;
+        while(arguments >> argument) test.arguments.push_back(argument);
+
+        std::string input = line.substr(second + 1);
+        for(size_t i = 0; i < input.size(); i++){
+            if(input[i] == '\\' && i + 1 < input.size() && input[i + 1] == 'n'){
+                test.input += '\n';
+                i++;
+            }
+            else test.input += input[i];
+        }
+        test.input += '\n';
+        cases.push_back(test);
+    }
+    return true;
+}
+
+/**
+ * Writes one case as a line of the corpus (the last new line of the input
+ * is left out, the others are written as \n).
+ */
+void write_corpus_line(std::ostream& ostr, const Perf_case& test){
+    ostr << test.name << '\t';
+    for(size_t i = 0; i < test.arguments.size(); i++) ostr << (i > 0 ? " " : "") << test.arguments[i];
+    ostr << '\t';
+
+    size_t end = test.input.size();
+    if(end > 0 && test.input[end - 1] == '\n') end--;
+    for(size_t i = 0; i < end; i++){
+        if(test.input[i] == '\n') ostr << "\\n";
+        else ostr << test.input[i];
+    }
+    ostr << '\n';
+}
+
+#endif
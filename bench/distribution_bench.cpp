@@ -0,0 +1,135 @@
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "../distribution.hpp"
+
+/**
+ * Microbenchmarks of distribution.hpp: every constructor, every arithmetic
+ * operator (dist op dist, dist op scalar, scalar op dist), normalize and
+ * print, for distributions with 10^2 to 10^6 bins (`make bench`).
+ *
+ * Every benchmark is repeated until it ran at least BENCH_MIN_SECONDS
+ * (and at least BENCH_MIN_REPETITIONS times). One JSON object per line:
+ * {"benchmark":"dist + dist","bins":1000,"repetitions":12,
+ *  "mean_seconds":...,"stddev_seconds":...,"bins_per_second":...}
+ * bins is the number of bins of each operand. dist op dist goes through
+ * every pair of bins, so it is measured only while bins^2 is at most
+ * BENCH_MAX_PAIRS, larger sizes are written with "skipped":true.
+ *
+ * Usage: distribution_bench [max_bins]
+ */
+
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_MIN_REPETITIONS 3
+#define BENCH_MAX_PAIRS 1e7
+
+using real = double;
+
+/**
+ * Measures the function and writes one JSON line.
+ */
+void measure(const std::string& name, size_t bins, const std::function<void()>& function){
+    std::vector<double> times;
+    double total = 0;
+    while(total < BENCH_MIN_SECONDS || times.size() < BENCH_MIN_REPETITIONS){
+        auto start = std::chrono::steady_clock::now();
+        function();
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        total += times.back();
+    }
+
+    double mean = total / times.size();
+    double variance = 0;
+    for(double time : times) variance += (time - mean) * (time - mean);
+    variance /= times.size() - 1;
+
+    std::cout << "{\"benchmark\":\"" << name << "\",\"bins\":" << bins
+              << ",\"repetitions\":" << times.size()
+              << ",\"mean_seconds\":" << mean
+              << ",\"stddev_seconds\":" << std::sqrt(variance)
+              << ",\"bins_per_second\":" << bins / mean << "}" << std::endl;
+}
+
+void skip(const std::string& name, size_t bins){
+    std::cout << "{\"benchmark\":\"" << name << "\",\"bins\":" << bins << ",\"skipped\":true}" << std::endl;
+}
+
+int main(int argc, char **argv){
+    size_t max_bins = 1000000;
+    if(argc > 1) std::stringstream(argv[1]) >> max_bins;
+    std::cout.precision(6);
+
+    // keeps the results alive, so the compiler can't drop the computation
+    volatile real sink = 0;
+
+    for(size_t bins = 100; bins <= max_bins; bins *= 10){
+        real to = bins - 1;
+
+        // constructors
+        measure("normal", bins, [&]{ sink = Distribution<real>('~', 0, to, 1, 2).get_to(); });
+        measure("uniform", bins, [&]{ sink = Distribution<real>('u', 0, to, 1, 2).get_to(); });
+
+        std::vector<real> histogram(bins, 1);
+        measure("histogram", bins, [&]{ sink = Distribution<real>(histogram, 0, 1).get_to(); });
+
+        // operands without zero, so that they can be divisors
+        Distribution<real> a('~', 1, bins, 1, 2);
+        Distribution<real> b('u', 1, bins, 1, 2);
+        Distribution<real>::Bins stored_bins = a.get_bins();
+        measure("stored bins", bins, [&]{
+            Distribution<real>::Bins copy = stored_bins;
+            sink = Distribution<real>(std::move(copy), 1).get_to();
+        });
+
+        const char operators[] = {'+', '-', '*', '/'};
+        for(char op : operators){
+            std::string name(1, op);
+            if((double)bins * bins <= BENCH_MAX_PAIRS){
+                measure("dist " + name + " dist", bins, [&]{
+                    switch(op){
+                        case '+': sink = (a + b).get_to(); break;
+                        case '-': sink = (a - b).get_to(); break;
+                        case '*': sink = (a * b).get_to(); break;
+                        default: sink = (a / b).get_to(); break;
+                    }
+                });
+            }
+            else skip("dist " + name + " dist", bins);
+
+            measure("dist " + name + " scalar", bins, [&]{
+                switch(op){
+                    case '+': sink = (a + (real)3).get_to(); break;
+                    case '-': sink = (a - (real)3).get_to(); break;
+                    case '*': sink = (a * (real)3).get_to(); break;
+                    default: sink = (a / (real)3).get_to(); break;
+                }
+            });
+            measure("scalar " + name + " dist", bins, [&]{
+                switch(op){
+                    case '+': sink = ((real)3 + a).get_to(); break;
+                    case '-': sink = ((real)3 - a).get_to(); break;
+                    case '*': sink = ((real)3 * a).get_to(); break;
+                    default: sink = ((real)3 / a).get_to(); break;
+                }
+            });
+        }
+
+        measure("normalize", bins, [&]{ a.normalize(); });
+
+        std::stringstream output;
+        measure("print -r 25", bins, [&]{
+            output.str("");
+            a.print(output, 25);
+        });
+        measure("print -r -1", bins, [&]{
+            output.str("");
+            a.print(output, -1);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <string>
+
+#include "../expression.hpp"
+#include "../output_format.hpp"
+
+/**
+ * Throughput of formatting the results: the text output (star bars),
+ * the same CSV written with std::ostream << and with Result_writer
+ * (std::to_chars into a reused buffer), and JSON by Result_writer.
+ * Usage: format_bench [repetitions]
+ */
+
+using real = double;
+
+/**
+ * Measures the formatting function and prints results/s and MB/s.
+ */
+template <typename Function>
+void measure(const char* name, size_t bins, int repetitions, Function function){
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < repetitions; i++) bytes += function();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(22) << name << std::right << std::setw(8) << bins << " bins "
+              << std::setw(12) << (size_t)(repetitions / seconds) << " results/s "
+              << std::setw(10) << std::fixed << std::setprecision(1) << bytes / seconds / 1e6 << " MB/s"
+              << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+/**
+ * CSV of the bins written by std::ostream (as the formatting was done before).
+ */
+size_t ostream_csv(const Token<real>& result, std::vector<real>& bins, std::stringstream& output){
+    output.str("");
+    const Distribution<real>* distribution = result.get_distribution();
+    distribution->to_bins(bins);
+    real origin = distribution->get_from();
+    real bin_size = distribution->get_bin_size();
+    for(size_t i = 0; i < bins.size(); i++){
+        output << 0 << ",bin," << std::setw(9) << origin + (i - 0.5) * bin_size << ","
+               << std::setw(9) << origin + (i + 0.5) * bin_size << "," << bins[i] << std::endl;
+    }
+    return output.tellp();
+}
+
+int main(int argc, char **argv){
+    int repetitions = 20000;
+    if(argc > 1) std::stringstream(argv[1]) >> repetitions;
+
+    const char* expressions[] = {"0 ~ 10 * 2", "0 ~ 1000", "0 ~ 100000"};
+    for(const char* text : expressions){
+        Expression<real> expression(1, 2);
+        std::stringstream input(text);
+        if(!expression.parse_input(input, false) || !expression.evaluate(-1)) return 1;
+        const Token<real>& result = *expression.result();
+
+        std::vector<real> bins;
+        result.get_distribution()->to_bins(bins);
+        int count = std::max<int>(1, repetitions / (int)(1 + bins.size() / 100));
+
+        std::stringstream output;
+        Result_writer<real> csv(false, -1);
+        Result_writer<real> json(true, -1);
+
+        std::cout << "Expression: " << text << std::endl;
+        measure("text (-r 25)", bins.size(), count, [&]{
+            output.str("");
+            result.print(output, 25);
+            return (size_t)output.tellp();
+        });
+        measure("csv std::ostream", bins.size(), count, [&]{ return ostream_csv(result, bins, output); });
+        measure("csv Result_writer", bins.size(), count, [&]{
+            csv.clear();
+            csv.result(&result, 0);
+            return csv.get_buffer().size();
+        });
+        measure("json Result_writer", bins.size(), count, [&]{
+            json.clear();
+            json.result(&result, 0);
+            return json.get_buffer().size();
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,255 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <getopt.h>
+#include <signal.h>
+
+#include "process.hpp"
+#include "corpus.hpp"
+
+/**
+ * Performance regression harness (`make perf`).
+ *
+ * Runs every case of the corpus (bench/perf_corpus.txt) several times with
+ * ./aprox and compares the minimal time and the peak RSS with the baseline
+ * (bench/perf_baseline.json). The time is the CPU time of the process
+ * (user and system), which is much less noisy than the wall time on a shared
+ * machine, the minimal wall time is printed too. Noise only adds time, so
+ * the minimum of the runs is steadier than the median, the runs go round
+ * the corpus (a burst of noise hits a case only in some of its runs), a case
+ * that seems slower is measured again before it is reported, and the cases
+ * take about a second each so that the start of the program doesn't matter.
+ * The harness fails (exit code 1) when some case is more than the threshold
+ * (and more than PERF_MIN_DIFFERENCE) slower or more than the threshold bigger.
+ * `make perf-baseline` (option -u) writes the baseline instead, it should
+ * be written on the machine where the harness runs.
+ *
+ * Without a baseline the harness compares programs (option -x, more times,
+ * default ./aprox): the minimal CPU time of every case and program and the
+ * speedup against the first program (`make release-report`).
+ *
+ * Corpus: one case per line, `name<TAB>arguments<TAB>input` (see corpus.hpp).
+ * Baseline: one JSON object per line:
+ * {"name":"sum","min_seconds":1.05,"min_wall_seconds":1.06,"peak_rss_kb":5120}
+ *
+ * Usage: perf_regression [-n runs] [-t percent] [-u] [-x program]... corpus [baseline]
+ */
+
+#define PERF_RUNS_DEFAULT 7
+#define PERF_THRESHOLD_DEFAULT 25
+
+// smaller differences of the minimal time are noise (seconds)
+#define PERF_MIN_DIFFERENCE 0.1
+
+struct Perf_result{
+    double min_seconds; // CPU time
+    long peak_rss_kb;
+};
+
+/**
+ * Reads the baseline (missing file = empty baseline).
+ */
+std::map<std::string, Perf_result> read_baseline(const char* path){
+    std::map<std::string, Perf_result> baseline;
+    std::ifstream file(path);
+    std::string line;
+    while(std::getline(file, line)){
+        size_t name = line.find("\"name\":\"");
+        size_t seconds = line.find("\"min_seconds\":");
+        size_t rss = line.find("\"peak_rss_kb\":");
+        if(name == std::string::npos || seconds == std::string::npos || rss == std::string::npos) continue;
+
+        name += 8;
+        Perf_result result;
+        result.min_seconds = std::stod(line.substr(seconds + 14));
+        result.peak_rss_kb = std::stol(line.substr(rss + 14));
+        baseline[line.substr(name, line.find('"', name) - name)] = result;
+    }
+    return baseline;
+}
+
+/**
+ * Minimal CPU and wall times and the maximal peak RSS of the runs of a case.
+ */
+struct Measurement{
+    double cpu = 0;
+    double wall = 0;
+    long peak_rss_kb = 0;
+    int runs = 0;
+};
+
+/**
+ * Runs the case with the program several times and adds the runs to the
+ * measurement. Returns bool (success)
+ */
+bool measure(const std::string& program, const Perf_case& test, int runs, Measurement& measurement){
+    for(int i = 0; i < runs; i++){
+        Process_result result;
+        if(!run_process(program, test.arguments, test.input, result) || !result.succeeded) return false;
+        bool first = measurement.runs++ == 0;
+        measurement.cpu = first ? result.seconds : std::min(measurement.cpu, result.seconds);
+        measurement.wall = first ? result.wall_seconds : std::min(measurement.wall, result.wall_seconds);
+        measurement.peak_rss_kb = std::max(measurement.peak_rss_kb, result.peak_rss_kb);
+    }
+    return true;
+}
+
+/**
+ * Returns bool (the measured CPU time is over the threshold and PERF_MIN_DIFFERENCE).
+ */
+bool is_slower(double cpu, const Perf_result& expected, double threshold){
+    return (cpu / expected.min_seconds - 1) * 100 > threshold && cpu - expected.min_seconds > PERF_MIN_DIFFERENCE;
+}
+
+/**
+ * Prints the minimal CPU times of the programs and the speedups against
+ * the first one. Returns the exit code.
+ */
+int compare_programs(const std::vector<std::string>& programs, const std::vector<Perf_case>& cases, int runs){
+    std::cout << std::left << std::setw(16) << "case";
+    for(auto&& program : programs){
+        std::cout << std::right << std::setw(std::max<int>(12, program.size() + 2)) << program << std::setw(9) << "speedup";
+    }
+    std::cout << std::endl;
+
+    std::vector<double> totals(programs.size(), 0);
+    for(auto&& test : cases){
+        std::cout << std::left << std::setw(16) << test.name << std::right << std::fixed;
+        double first = 0;
+        for(size_t i = 0; i < programs.size(); i++){
+            Measurement measurement;
+            if(!measure(programs[i], test, runs, measurement)){
+                std::cerr << std::endl << "ERROR: CASE " << test.name << " FAILED WITH " << programs[i] << std::endl;
+                return 2;
+            }
+            double cpu = measurement.cpu;
+            if(i == 0) first = cpu;
+            totals[i] += cpu;
+            std::cout << std::setw(std::max<int>(12, programs[i].size() + 2)) << std::setprecision(4) << cpu
+                      << std::setw(8) << std::setprecision(2) << first / cpu << "x" << std::flush;
+        }
+        std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+
+    std::cout << std::left << std::setw(16) << "total" << std::right << std::fixed;
+    for(size_t i = 0; i < programs.size(); i++){
+        std::cout << std::setw(std::max<int>(12, programs[i].size() + 2)) << std::setprecision(4) << totals[i]
+                  << std::setw(8) << std::setprecision(2) << totals[0] / totals[i] << "x";
+    }
+    std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv){
+    int runs = PERF_RUNS_DEFAULT;
+    double threshold = PERF_THRESHOLD_DEFAULT;
+    bool update = false;
+    std::vector<std::string> programs;
+    const char* usage = "Usage: perf_regression [-n runs] [-t percent] [-u] [-x program]... corpus [baseline]";
+
+    int c;
+    while((c = getopt(argc, argv, "n:t:ux:")) != -1){
+        switch(c){
+            case 'n': runs = std::max(1, atoi(optarg)); break;
+            case 't': threshold = atof(optarg); break;
+            case 'u': update = true; break;
+            case 'x': programs.push_back(optarg); break;
+            default:
+                std::cerr << usage << std::endl;
+                return 2;
+        }
+    }
+    if(programs.empty()) programs.push_back("./aprox");
+
+    // the baseline is compared with one program
+    bool compare = argc - optind == 1;
+    if((argc - optind != 2 && !compare) || (!compare && programs.size() != 1) || (compare && update)){
+        std::cerr << usage << std::endl;
+        return 2;
+    }
+    const char* corpus_path = argv[optind];
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Perf_case> cases;
+    if(!read_corpus(corpus_path, cases)){
+        std::cerr << "ERROR: UNABLE TO READ THE CORPUS " << corpus_path << std::endl;
+        return 2;
+    }
+    if(compare) return compare_programs(programs, cases, runs);
+
+    const char* baseline_path = argv[optind + 1];
+    std::map<std::string, Perf_result> baseline = read_baseline(baseline_path);
+
+    std::stringstream results;
+    bool regressed = false;
+    std::cout << std::left << std::setw(16) << "case" << std::right << std::setw(12) << "wall [s]" << std::setw(12) << "CPU [s]"
+              << std::setw(12) << "baseline" << std::setw(10) << "change" << std::setw(12) << "RSS [kB]"
+              << std::setw(12) << "baseline" << "  status" << std::endl;
+
+    // one run of every case in a round
+    std::vector<Measurement> measured(cases.size());
+    for(int run = 0; run < runs; run++){
+        for(size_t i = 0; i < cases.size(); i++){
+            if(!measure(programs[0], cases[i], 1, measured[i])){
+                std::cerr << "ERROR: CASE " << cases[i].name << " FAILED." << std::endl;
+                return 2;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < cases.size(); i++){
+        const Perf_case& test = cases[i];
+        auto base = baseline.find(test.name);
+        if(!update && base != baseline.end() && is_slower(measured[i].cpu, base->second, threshold) &&
+           !measure(programs[0], test, runs, measured[i])){
+            std::cerr << "ERROR: CASE " << test.name << " FAILED." << std::endl;
+            return 2;
+        }
+        double cpu = measured[i].cpu;
+        double wall = measured[i].wall;
+        long peak_rss_kb = measured[i].peak_rss_kb;
+
+        results << "{\"name\":\"" << test.name << "\",\"min_seconds\":" << cpu
+                << ",\"min_wall_seconds\":" << wall << ",\"peak_rss_kb\":" << peak_rss_kb << "}\n";
+
+        std::cout << std::left << std::setw(16) << test.name << std::right << std::fixed << std::setprecision(4)
+                  << std::setw(12) << wall << std::setw(12) << cpu;
+        if(base == baseline.end()){
+            std::cout << std::setw(12) << "-" << std::setw(10) << "-" << std::setw(12) << peak_rss_kb
+                      << std::setw(12) << "-" << "  NEW" << std::endl;
+            continue;
+        }
+
+        const Perf_result& expected = base->second;
+        double change = (cpu / expected.min_seconds - 1) * 100;
+        bool slower = is_slower(cpu, expected, threshold);
+        bool bigger = peak_rss_kb > expected.peak_rss_kb * (1 + threshold / 100);
+        regressed = regressed || slower || bigger;
+
+        std::cout << std::setw(12) << expected.min_seconds << std::setw(9) << std::setprecision(1) << change << "%"
+                  << std::setw(12) << peak_rss_kb << std::setw(12) << expected.peak_rss_kb << "  "
+                  << (slower ? "SLOWER " : "") << (bigger ? "MORE MEMORY" : "") << (slower || bigger ? "" : "OK")
+                  << std::endl;
+    }
+
+    if(update){
+        std::ofstream file(baseline_path);
+        file << results.str();
+        if(!file){
+            std::cerr << "ERROR: UNABLE TO WRITE THE BASELINE " << baseline_path << std::endl;
+            return 2;
+        }
+        std::cout << "BASELINE WRITTEN TO " << baseline_path << std::endl;
+        return 0;
+    }
+    if(regressed){
+        std::cout << "PERFORMANCE REGRESSION (THRESHOLD " << threshold << "%)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#ifndef BENCH_PROCESS_HPP_
+#define BENCH_PROCESS_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/**
+ * Runs of whole programs for the harnesses in bench/ (perf_regression,
+ * worst_case_fuzzer): the input is written to stdin, stdout and stderr
+ * are thrown away, and the resources of the child are measured by wait4.
+ */
+
+/**
+ * Resources and the end of one run.
+ */
+struct Process_result{
+    double seconds = 0; // CPU time (user and system)
+    double wall_seconds = 0;
+    long peak_rss_kb = 0;
+    bool succeeded = false; // exit code 0
+    bool killed_by_limit = false; // CPU time or memory limit
+};
+
+/**
+ * Runs the program with the arguments and the input on stdin. The CPU time
+ * (seconds) and the address space (bytes) of the child can be limited,
+ * 0 = no limit. Returns bool (the child was started and waited for).
+ */
+bool run_process(const std::string& program, const std::vector<std::string>& arguments, const std::string& input,
+                 Process_result& result, int cpu_limit = 0, size_t memory_limit = 0){
+    int pipe_fds[2];
+    if(pipe(pipe_fds) < 0) return false;
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t child = fork();
+    if(child < 0){
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return false;
+    }
+    if(child == 0){
+        int null = open("/dev/null", O_WRONLY);
+        dup2(pipe_fds[0], 0);
+        dup2(null, 1);
+        dup2(null, 2);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+
+        if(cpu_limit > 0){
+            rlimit limit = {(rlim_t)cpu_limit, (rlim_t)cpu_limit + 1};
+            setrlimit(RLIMIT_CPU, &limit);
+        }
+        if(memory_limit > 0){
+            rlimit limit = {(rlim_t)memory_limit, (rlim_t)memory_limit};
+            setrlimit(RLIMIT_AS, &limit);
+        }
+
+        std::vector<char*> argv;
+        argv.push_back((char*)program.c_str());
+        for(auto&& argument : arguments) argv.push_back((char*)argument.c_str());
+        argv.push_back(nullptr);
+        execv(program.c_str(), argv.data());
+        _exit(127);
+    }
+
+    close(pipe_fds[0]);
+    size_t written = 0;
+    while(written < input.size()){
+        ssize_t count = write(pipe_fds[1], input.data() + written, input.size() - written);
+        if(count <= 0) break;
+        written += count;
+    }
+    close(pipe_fds[1]);
+
+    int status;
+    rusage usage;
+    if(wait4(child, &status, 0, &usage) < 0) return false;
+    result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                     (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    // SIGXCPU over the CPU time, SIGKILL over the hard limit, an abort when new fails
+    result.killed_by_limit = WIFSIGNALED(status) && (WTERMSIG(status) == SIGXCPU || WTERMSIG(status) == SIGKILL ||
+                                                     (memory_limit > 0 && WTERMSIG(status) == SIGABRT));
+    return true;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <random>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+
+#include "process.hpp"
+#include "corpus.hpp"
+
+/**
+ * Cost-guided fuzzer of worst cases (`make fuzz`).
+ *
+ * Mutates infix expressions and runs ./aprox with each of them, the
+ * mutants that take the most CPU time or the most memory per byte of the
+ * input are kept and mutated further. Mutations are aimed at the known
+ * worst cases: deeper parenthesis nesting, wider supports, finer numbers,
+ * reciprocals near zero, squares and combinations of the kept expressions.
+ *
+ * Every run is limited (FUZZ_CPU_LIMIT, FUZZ_MEMORY_LIMIT and --max-cost
+ * FUZZ_MAX_COST), mutants over a limit or with an error are thrown away,
+ * so the fuzzer runs offline on one machine and every kept case stays
+ * usable as a performance regression test. Scores subtract the cost of
+ * the trivial input "1" (the start of the program).
+ *
+ * The kept cases (keep per objective) are written into the corpus file in
+ * the format of perf_regression (see corpus.hpp), an existing corpus is
+ * read first and fuzzed further:
+ * make perf PERF_CORPUS=bench/worst_case_corpus.txt PERF_BASELINE=bench/worst_case_baseline.json
+ *
+ * Usage: worst_case_fuzzer [-n iterations] [-k keep] [-s seed] [-x program] corpus
+ */
+
+#define FUZZ_ITERATIONS_DEFAULT 300
+#define FUZZ_KEEP_DEFAULT 6
+#define FUZZ_MAX_BYTES 160
+
+// limits of one run (CPU seconds, bytes of the address space, operations)
+#define FUZZ_CPU_LIMIT 1
+#define FUZZ_MEMORY_LIMIT (2UL << 30)
+#define FUZZ_MAX_COST "1e9"
+
+/**
+ * Measured input. Scores are the CPU seconds and the kB of RSS above the
+ * start of the program, per byte of the input.
+ */
+struct Fuzz_entry{
+    std::string input;
+    double seconds;
+    long peak_rss_kb;
+    double time_score;
+    double memory_score;
+};
+
+class Worst_case_fuzzer{
+
+    std::string program;
+    size_t keep;
+    std::mt19937 random;
+
+    double base_seconds = 0;
+    long base_rss_kb = 0;
+
+    std::vector<std::string> seeds;
+    std::vector<Fuzz_entry> slowest; // sorted by time_score
+    std::vector<Fuzz_entry> biggest; // sorted by memory_score
+    std::set<std::string> tried;
+
+public:
+
+    size_t runs = 0;
+    size_t rejected = 0; // errors and mutants over a limit
+    size_t killed = 0; // rejected mutants killed by the CPU time or memory limit (not stopped by --max-cost)
+
+    Worst_case_fuzzer(const std::string& program, size_t keep, unsigned int seed) : program(program),
+                                                                                       keep(keep),
+                                                                                       random(seed) {
+        seeds = {"0 ~ 10 + 0 ~ 10", "0 u 100 * 0 u 100", "1 / 0.1 ~ 1", "((0 ~ 10 - 3))",
+                 "let x = 0 ~ 20; x * x - x", "0 ~ 100 - 0 u 50 / 2", "0.5 ~ 2 / 0.1 u 1"};
+    }
+
+    void add_seed(const std::string& input){
+        seeds.push_back(input);
+    }
+
+    /**
+     * Measures the start of the program and every seed.
+     * Returns bool (success: the program runs)
+     */
+    bool start(){
+        Process_result result;
+        if(!run_process(program, {"-r", "1"}, "1\n", result) || !result.succeeded) return false;
+        base_seconds = result.seconds;
+        base_rss_kb = result.peak_rss_kb;
+
+        for(auto&& seed : seeds) try_input(seed);
+        return true;
+    }
+
+    /**
+     * One mutant of a kept case or a seed.
+     */
+    void step(){
+        std::vector<const Fuzz_entry*> pool;
+        for(auto&& entry : slowest) pool.push_back(&entry);
+        for(auto&& entry : biggest) pool.push_back(&entry);
+        std::string parent = pool.empty() ? seeds[pick(seeds.size())] : pool[pick(pool.size())]->input;
+
+        std::string mutant = parent;
+        int mutations = 1 + pick(3);
+        for(int i = 0; i < mutations; i++) mutant = mutate(mutant);
+        try_input(mutant);
+    }
+
+    /**
+     * Writes the kept cases into the corpus. Returns bool (success)
+     */
+    bool write(const char* path) const{
+        std::ofstream file(path);
+        file << "# Worst cases found by bench/worst_case_fuzzer (make fuzz): the most CPU time and the most\n"
+             << "# memory per byte of the input, name<TAB>arguments<TAB>input (see bench/corpus.hpp)\n";
+        write_entries(file, slowest, "slowest");
+
+        // cases that are both among the slowest and the biggest are written once
+        std::vector<Fuzz_entry> only_biggest;
+        for(auto&& entry : biggest){
+            if(std::none_of(slowest.begin(), slowest.end(), [&](const Fuzz_entry& slow){ return slow.input == entry.input; }))
+                only_biggest.push_back(entry);
+        }
+        write_entries(file, only_biggest, "biggest");
+        return (bool)file;
+    }
+
+    void print(std::ostream& ostr) const{
+        ostr << "RUNS: " << runs << ", REJECTED: " << rejected << " (KILLED BY A LIMIT: " << killed << ")\n";
+        print_entries(ostr, slowest, "slowest");
+        print_entries(ostr, biggest, "biggest");
+        ostr << std::flush;
+    }
+
+private:
+
+    size_t pick(size_t count){
+        return std::uniform_int_distribution<size_t>(0, count - 1)(random);
+    }
+
+    /**
+     * Runs the input once and keeps it when it is among the worst ones.
+     */
+    void try_input(const std::string& input){
+        if(input.empty() || input.size() > FUZZ_MAX_BYTES || !tried.insert(input).second) return;
+
+        Process_result result;
+        runs++;
+        std::vector<std::string> arguments = case_arguments();
+        arguments.insert(arguments.end(), {"--max-cost", FUZZ_MAX_COST});
+        if(!run_process(program, arguments, input + "\n", result,
+                        FUZZ_CPU_LIMIT, FUZZ_MEMORY_LIMIT) || !result.succeeded){
+            rejected++;
+            if(result.killed_by_limit) killed++;
+            return;
+        }
+
+        Fuzz_entry entry = {input, result.seconds, result.peak_rss_kb,
+                            std::max(0.0, result.seconds - base_seconds) / input.size(),
+                            std::max(0L, result.peak_rss_kb - base_rss_kb) / (double)input.size()};
+        if(insert(slowest, entry, [](const Fuzz_entry& a){ return a.time_score; })){
+            std::cout << "SLOWER: " << std::scientific << std::setprecision(2) << entry.time_score
+                      << " s/B  " << entry.input << std::defaultfloat << std::setprecision(6) << std::endl;
+        }
+        if(insert(biggest, entry, [](const Fuzz_entry& a){ return a.memory_score; })){
+            std::cout << "BIGGER: " << std::fixed << std::setprecision(1) << entry.memory_score
+                      << " kB/B  " << entry.input << std::defaultfloat << std::setprecision(6) << std::endl;
+        }
+    }
+
+    /**
+     * Inserts the entry into the list sorted by the score (the best first)
+     * when it is among the keep best ones. Returns bool (inserted)
+     */
+    bool insert(std::vector<Fuzz_entry>& list, const Fuzz_entry& entry, double (*score)(const Fuzz_entry&)){
+        if(score(entry) <= 0) return false;
+
+        // the same expression with other parentheses is kept once, with the better score
+        auto same = std::find_if(list.begin(), list.end(), [&](const Fuzz_entry& kept){
+            return without_parentheses(kept.input) == without_parentheses(entry.input);
+        });
+        if(same != list.end()){
+            if(score(*same) >= score(entry)) return false;
+            list.erase(same);
+        }
+        if(list.size() >= keep && score(entry) <= score(list.back())) return false;
+
+        auto position = std::find_if(list.begin(), list.end(), [&](const Fuzz_entry& kept){
+            return score(kept) < score(entry);
+        });
+        list.insert(position, entry);
+        if(list.size() > keep) list.pop_back();
+        return true;
+    }
+
+    static std::string without_parentheses(const std::string& input){
+        std::string result;
+        for(char c : input){
+            if(c != '(' && c != ')' && c != ' ') result += c;
+        }
+        return result;
+    }
+
+    /**
+     * Applies one random mutation to the expression.
+     */
+    std::string mutate(const std::string& input){
+        static const char operators[] = {'+', '-', '*', '/'};
+        std::vector<std::pair<size_t, size_t>> numbers = find_numbers(input);
+
+        switch(pick(8)){
+            case 0:{ // deeper nesting
+                size_t depth = 1 + pick(8);
+                return std::string(depth, '(') + input + std::string(depth, ')');
+            }
+            case 1: // wider support or finer number
+            case 2:{
+                if(numbers.empty()) return input;
+                auto number = numbers[pick(numbers.size())];
+                double value = std::stod(input.substr(number.first, number.second));
+                static const double factors[] = {10, 100, 0.1, 0.01};
+                std::string text = number_text(value * factors[pick(4)]);
+                return input.substr(0, number.first) + text + input.substr(number.first + number.second);
+            }
+            case 3: // reciprocal (near zero when the support starts close to it)
+                return "1 / (" + input + ")";
+            case 4:{ // another operator
+                std::vector<size_t> positions;
+                for(size_t i = 0; i < input.size(); i++){
+                    if(std::find(std::begin(operators), std::end(operators), input[i]) != std::end(operators))
+                        positions.push_back(i);
+                }
+                if(positions.empty()) return input;
+                std::string mutant = input;
+                mutant[positions[pick(positions.size())]] = operators[pick(4)];
+                return mutant;
+            }
+            case 5: // square
+                return "(" + input + ") * (" + input + ")";
+            case 6:{ // combination with a kept case
+                std::string other = slowest.empty() ? seeds[pick(seeds.size())] : slowest[pick(slowest.size())].input;
+                if(other.find(';') != std::string::npos) other = seeds[pick(seeds.size())];
+                if(other.find(';') != std::string::npos) return input;
+                return input + " " + operators[pick(4)] + " (" + other + ")";
+            }
+            default:{ // a number becomes a distribution
+                if(numbers.empty()) return input;
+                auto number = numbers[pick(numbers.size())];
+                std::string text = input.substr(number.first, number.second);
+                return input.substr(0, number.first) + "(" + text + " ~ " + text + "0)" +
+                       input.substr(number.first + number.second);
+            }
+        }
+    }
+
+    /**
+     * Text of the number without an exponent (the parser doesn't read it).
+     */
+    static std::string number_text(double value){
+        char text[64];
+        snprintf(text, sizeof(text), "%.6f", value);
+        std::string number = text;
+        number.erase(number.find_last_not_of('0') + 1);
+        if(number.back() == '.') number.pop_back();
+        return number;
+    }
+
+    /**
+     * Positions and lengths of the numbers in the expression.
+     */
+    static std::vector<std::pair<size_t, size_t>> find_numbers(const std::string& input){
+        std::vector<std::pair<size_t, size_t>> numbers;
+        for(size_t i = 0; i < input.size(); i++){
+            if(!std::isdigit((unsigned char)input[i])) continue;
+            size_t end = i;
+            while(end < input.size() && (std::isdigit((unsigned char)input[end]) || input[end] == '.')) end++;
+            numbers.emplace_back(i, end - i);
+            i = end;
+        }
+        return numbers;
+    }
+
+    /**
+     * Arguments of the kept cases.
+     */
+    static std::vector<std::string> case_arguments(){
+        return {"-r", "25"};
+    }
+
+    static void write_entries(std::ostream& ostr, const std::vector<Fuzz_entry>& list, const char* prefix){
+        for(size_t i = 0; i < list.size(); i++){
+            write_corpus_line(ostr, {std::string(prefix) + "_" + std::to_string(i + 1), case_arguments(), list[i].input});
+        }
+    }
+
+    static void print_entries(std::ostream& ostr, const std::vector<Fuzz_entry>& list, const char* prefix){
+        for(size_t i = 0; i < list.size(); i++){
+            ostr << std::left << std::setw(12) << std::string(prefix) + "_" + std::to_string(i + 1) << std::right
+                 << std::fixed << std::setprecision(4) << std::setw(9) << list[i].seconds << " s"
+                 << std::setw(10) << list[i].peak_rss_kb << " kB  " << list[i].input
+                 << std::defaultfloat << std::setprecision(6) << '\n';
+        }
+    }
+};
+
+int main(int argc, char **argv){
+    int iterations = FUZZ_ITERATIONS_DEFAULT;
+    int keep = FUZZ_KEEP_DEFAULT;
+    unsigned int seed = 1;
+    std::string program = "./aprox";
+    const char* usage = "Usage: worst_case_fuzzer [-n iterations] [-k keep] [-s seed] [-x program] corpus";
+
+    int c;
+    while((c = getopt(argc, argv, "n:k:s:x:")) != -1){
+        switch(c){
+            case 'n': iterations = std::max(0, atoi(optarg)); break;
+            case 'k': keep = std::max(1, atoi(optarg)); break;
+            case 's': seed = strtoul(optarg, nullptr, 10); break;
+            case 'x': program = optarg; break;
+            default:
+                std::cerr << usage << std::endl;
+                return 2;
+        }
+    }
+    if(argc - optind != 1){
+        std::cerr << usage << std::endl;
+        return 2;
+    }
+    const char* corpus_path = argv[optind];
+    signal(SIGPIPE, SIG_IGN);
+
+    Worst_case_fuzzer fuzzer(program, keep, seed);
+    std::vector<Perf_case> existing;
+    if(read_corpus(corpus_path, existing)){
+        for(auto&& test : existing) fuzzer.add_seed(test.input.substr(0, test.input.size() - 1));
+    }
+
+    if(!fuzzer.start()){
+        std::cerr << "ERROR: UNABLE TO RUN " << program << std::endl;
+        return 2;
+    }
+    for(int i = 0; i < iterations; i++) fuzzer.step();
+
+    fuzzer.print(std::cout);
+    if(!fuzzer.write(corpus_path)){
+        std::cerr << "ERROR: UNABLE TO WRITE THE CORPUS " << corpus_path << std::endl;
+        return 2;
+    }
+    std::cout << "CORPUS WRITTEN TO " << corpus_path << std::endl;
+    return 0;
+}
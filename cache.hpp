@@ -0,0 +1,109 @@
+#ifndef CACHE_HPP_
+#define CACHE_HPP_
+
+#include <map>
+#include <list>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include "distribution.hpp"
+
+/**
+ * Cache of leaf distributions (i.e. `10 ~ 50`) shared by threads.
+ * A leaf is created only once for each combination of its parameters,
+ * later only its copy is returned. When the cache is full, it is cleared.
+ */
+template <typename real>
+class Leaf_cache{
+
+    // operator, from, to, bin_size, standard deviation quotient
+    using Key = std::tuple<char, real, real, real, real>;
+
+    std::map<Key, Distribution<real>> leaves;
+    size_t capacity;
+    std::mutex mutex;
+
+public:
+
+    Leaf_cache(size_t capacity) : capacity(capacity) {}
+
+    /**
+     * Returns a copy of the cached leaf, creates it on a miss.
+     * Leaves with an error are not cached.
+     */
+    std::unique_ptr<Distribution<real>> get(char op, real from, real to, real bin_size,
+                                            real std_deviation_quotient){
+        Key key(op, from, to, bin_size, std_deviation_quotient);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto leaf = leaves.find(key);
+            if(leaf != leaves.end()) return std::make_unique<Distribution<real>>(leaf->second);
+        }
+
+        // the leaf is created outside of the lock, so the threads don't wait
+        auto created = std::make_unique<Distribution<real>>(op, from, to, bin_size, std_deviation_quotient);
+        if(created->error_occurred) return created;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(leaves.size() >= capacity) leaves.clear();
+        leaves.emplace(key, *created);
+        return created;
+    }
+};
+
+/**
+ * Least recently used cache of results (key and value are strings)
+ * shared by threads. It is limited by the number of entries and by the
+ * bytes of their keys and values, a result bigger than the limit is not
+ * cached at all.
+ */
+class Result_cache{
+
+    std::list<std::pair<std::string, std::string>> entries; // the most recently used first
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> index;
+    size_t capacity;
+    size_t max_bytes;
+    size_t bytes = 0;
+    std::mutex mutex;
+
+public:
+
+    Result_cache(size_t capacity, size_t max_bytes) : capacity(capacity), max_bytes(max_bytes) {}
+
+    /**
+     * Returns bool (hit), the result is saved into value.
+     */
+    bool get(const std::string& key, std::string& value){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = index.find(key);
+        if(entry == index.end()) return false;
+
+        entries.splice(entries.begin(), entries, entry->second);
+        value = entry->second->second;
+        return true;
+    }
+
+    void put(const std::string& key, const std::string& value){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = index.find(key);
+        if(entry != index.end()){
+            bytes -= entry->second->first.size() + entry->second->second.size();
+            entries.erase(entry->second);
+            index.erase(entry);
+        }
+        if(key.size() + value.size() > max_bytes) return;
+
+        entries.emplace_front(key, value);
+        index[key] = entries.begin();
+        bytes += key.size() + value.size();
+        while(entries.size() > capacity || bytes > max_bytes){
+            bytes -= entries.back().first.size() + entries.back().second.size();
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+};
+
+#endif
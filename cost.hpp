@@ -0,0 +1,143 @@
+#ifndef COST_HPP_
+#define COST_HPP_
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include "distribution.hpp"
+#include "expression_tree.hpp"
+
+/**
+ * Estimate of the cost of an expression before it is evaluated (`--explain`)
+ * and the admission control (`--max-cost`).
+ *
+ * The estimate is computed from the planned tree (supports and grids of the
+ * nodes, see Expression_tree) without computing any distribution. Bins of
+ * a node are bounded by its support and by the pairs of its operands (the
+ * same bound as Token::operation uses for the memory budget). Operations
+ * are pairs of bins for dist op dist and bins for the other steps. Peak
+ * memory follows the order of the evaluation: operands are freed when their
+ * parent is computed, values of variables are kept to the end. Bindings
+ * that are never referenced are not evaluated and cost nothing.
+ */
+
+// at most this many times the bin size is doubled to fit into --max-cost
+#define COST_MAX_COARSENING_STEPS 64
+
+/**
+ * Limit of the cost (--max-cost), an expression over it is rejected or
+ * computed with a coarser bin size.
+ */
+struct Cost_limit{
+    double max_operations = 0;
+    bool coarsen = false;
+};
+
+/**
+ * Estimated bins, operations and bytes of one node.
+ */
+template <typename real>
+struct Node_cost{
+    real bins = 0; // 0 for a number
+    real operations = 0;
+    real bytes = 0;
+};
+
+template <typename real>
+class Cost_estimate{
+public:
+
+    std::vector<Node_cost<real>> nodes;
+    real operations = 0;
+    real peak_bytes = 0;
+
+    /**
+     * Estimates the cost of the planned tree (Node::grid, Node::lo and
+     * Node::hi have to be computed).
+     */
+    static Cost_estimate estimate(const Expression_tree<real>& tree){
+        Cost_estimate estimate;
+        estimate.nodes.resize(tree.size());
+        std::vector<char> needed = tree.needed_nodes();
+
+        real live = 0;
+        for(size_t i = 0; i < tree.size(); i++){
+            const Node<real>& node = tree[i];
+            Node_cost<real>& cost = estimate.nodes[i];
+
+            // numbers and bindings that are never referenced cost nothing
+            if(node.op == 0 || node.is_number || !needed[i]) continue;
+            if(node.op == 'v') cost.bins = estimate.nodes[node.left].bins;
+            else cost.bins = support_bins(node);
+
+            if(node.op != 'v' && node.op != '@' && !node.is_leaf_distribution()){
+                real a = estimate.nodes[node.left].bins;
+                real b = estimate.nodes[node.right].bins;
+                cost.operations = a > 0 && b > 0 ? a * b : std::max(a, b);
+                cost.bins = std::min(cost.bins, std::max<real>(a, 1) * std::max<real>(b, 1));
+            }
+            else cost.operations = cost.bins;
+
+            cost.bytes = cost.bins * Distribution<real>::BIN_BYTES;
+            estimate.operations += cost.operations;
+
+            // the operands are freed after the parent is computed
+            live += cost.bytes;
+            estimate.peak_bytes = std::max(estimate.peak_bytes, live);
+            if(node.op != 'v' && node.left >= 0 && !tree[node.left].bound) live -= estimate.nodes[node.left].bytes;
+            if(node.op != 'v' && node.right >= 0 && !tree[node.right].bound) live -= estimate.nodes[node.right].bytes;
+        }
+        return estimate;
+    }
+
+    /**
+     * Prints every node (in the order of the evaluation) and the totals.
+     */
+    void print(std::ostream& ostr, const Expression_tree<real>& tree) const{
+        ostr << "EXPLAIN: " << tree.size() << " NODES (IN THE ORDER OF THE EVALUATION)" << '\n';
+        ostr << std::setw(5) << "node" << "  " << std::left << std::setw(12) << "step" << std::right
+             << std::setw(14) << "from" << std::setw(14) << "to" << std::setw(10) << "grid" << std::setw(12) << "bins"
+             << std::setw(14) << "operations" << std::setw(14) << "memory [B]" << '\n';
+
+        for(size_t i = 0; i < tree.size(); i++){
+            const Node<real>& node = tree[i];
+            const Node_cost<real>& cost = nodes[i];
+            ostr << std::setw(5) << i << "  " << std::left << std::setw(12) << step(tree, i) << std::right;
+            if(node.is_number){
+                ostr << std::setw(14) << node.number << '\n';
+                continue;
+            }
+            ostr << std::setw(14) << node.lo << std::setw(14) << node.hi << std::setw(10) << node.grid
+                 << std::setw(12) << cost.bins << std::setw(14) << cost.operations << std::setw(14) << cost.bytes << '\n';
+        }
+
+        int root = tree.root();
+        ostr << "ESTIMATE: " << operations << " OPERATIONS, PEAK MEMORY " << peak_bytes << " B, RESULT "
+             << (root >= 0 ? nodes[root].bins : 0) << " BINS" << std::endl;
+    }
+
+private:
+
+    /**
+     * Bins of the support of the node with its grid.
+     */
+    static real support_bins(const Node<real>& node){
+        if(!(node.grid > 0)) return 1;
+        return std::floor((node.hi - node.lo) / node.grid + 0.5) + 1;
+    }
+
+    /**
+     * Text of the step of the node: a number, an operator, a file or a variable.
+     */
+    static std::string step(const Expression_tree<real>& tree, size_t index){
+        const Node<real>& node = tree[index];
+        if(node.op == 0) return Expression_tree<real>::number_text(node.number);
+        if(node.op == '@') return "@" + tree.file(node);
+        if(node.op == 'v') return "variable " + std::to_string(node.left);
+        return std::string(1, node.op);
+    }
+};
+
+#endif
@@ -8,7 +8,11 @@
 #include <cmath>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <boost/math/distributions/normal.hpp>
+#include "trace.hpp"
+#include "memory.hpp"
 
 #define DIVISION_ERROR 100
 #define PRINT_BLOCK_PER_PROBABILITY 0.003
@@ -28,8 +32,17 @@
 
 template <typename real>
 class Distribution{
+public:
+
+    // value -> probability, the bins are counted by the memory budget
+    using Bins = std::map<real, real, std::less<real>, Counting_allocator<std::pair<const real, real>>>;
+
+    // memory of one bin
+    static constexpr size_t BIN_BYTES = sizeof(std::pair<const real, real>) + MEMORY_NODE_OVERHEAD;
 
-    std::map<real, real> distribution;
+private:
+
+    Bins distribution;
     char type;
     real from;
     real to;
@@ -53,6 +66,8 @@ public:
     Distribution(char type, real from_param, real to_param, real bin_size, 
                  real standard_deviation_quotient) : 
                                                               type(type),
+                                                              from(0),
+                                                              to(0),
                                                               bin_size(bin_size),
                                                               error_occurred(false) {
 
@@ -88,6 +103,50 @@ public:
         }
     }
 
+    /**
+     * Creates an empirical distribution from a histogram: bins[i] is the weight
+     * of the value (first_index + i) * bin_size. Empty bins at both ends are
+     * left out. If there is no weight, error_occurred is set.
+     */
+    Distribution(const std::vector<real>& bins, long long first_index, real bin_size) : type('e'),
+                                                                                        from(0),
+                                                                                        to(0),
+                                                                                        bin_size(bin_size),
+                                                                                        error_occurred(false) {
+        size_t begin = 0;
+        size_t end = bins.size();
+        while(begin < end && !(bins[begin] > 0)) begin++;
+        while(end > begin && !(bins[end - 1] > 0)) end--;
+        if(begin == end){
+            error_occurred = true;
+            return;
+        }
+
+        for(size_t i = begin; i < end; i++){
+            distribution.emplace_hint(distribution.end(), (first_index + (long long)i) * bin_size, bins[i]);
+        }
+        from = distribution.begin()->first;
+        to = distribution.rbegin()->first;
+        normalize();
+    }
+
+    /**
+     * Creates a distribution from stored bins (value -> probability).
+     */
+    Distribution(Bins&& bins, real bin_size) : distribution(std::move(bins)),
+                                                                type('m'),
+                                                                from(0),
+                                                                to(0),
+                                                                bin_size(bin_size),
+                                                                error_occurred(false) {
+        if(distribution.empty()){
+            error_occurred = true;
+            return;
+        }
+        from = distribution.begin()->first;
+        to = distribution.rbegin()->first;
+    }
+
     /**
      * COPY CONSTRUCTOR
      */
@@ -119,6 +178,32 @@ public:
         return *this;
     }
 
+    /**
+     * MOVE CONSTRUCTOR
+     */
+    Distribution(Distribution&& second) : distribution(std::move(second.distribution)),
+                                          from(second.from),
+                                          to(second.to),
+                                          bin_size(second.bin_size),
+                                          error_occurred(second.error_occurred) {}
+
+    /**
+     * MOVE ASSIGNMENT
+     */
+    Distribution& operator=(Distribution&& second){
+        if(&second == this)
+            return *this;
+
+        distribution = std::move(second.distribution);
+
+        from = second.from;
+        to = second.to;
+        bin_size = second.bin_size;
+        error_occurred = second.error_occurred;
+
+        return *this;
+    }
+
     /**
      * Creates normal distribution with standard_deviation_quotient defined
      * in arguments. Mean is computed from variables from and to.
@@ -150,11 +235,19 @@ public:
         
     }
 
+    /**
+     * Changes the bin_size used for rounding the results of the following
+     * operations (the stored bins stay as they are).
+     */
+    void set_bin_size(real new_bin_size){
+        bin_size = new_bin_size;
+    }
+
     /**
      * Finds nearest bin into which the number should go.
      */
-    real nearest_bin(real number){
-        int multiple = round((number-from) / bin_size);
+    real nearest_bin(real number) const{
+        long long multiple = std::llround((number-from) / bin_size);
         return multiple * bin_size + from;
     }
 
@@ -162,15 +255,68 @@ public:
      * Finds nearest bin into which the number should go, but the another_bin_size
      * is different from the bin_size of the distribution.
      */
-    real nearest_bin(real number, real another_bin_size){
-        int multiple = round((number-from) / another_bin_size);
+    real nearest_bin(real number, real another_bin_size) const{
+        long long multiple = std::llround((number-from) / another_bin_size);
         return multiple * another_bin_size + from;
     }
 
+    real get_from() const{
+        return from;
+    }
+
+    real get_to() const{
+        return to;
+    }
+
+    const Bins& get_bins() const{
+        return distribution;
+    }
+
+    real get_bin_size() const{
+        return bin_size;
+    }
+
+    /**
+     * Stores the distribution into an array of bins: bins[i] is the probability
+     * of the value get_from() + i * get_bin_size().
+     * Returns the number of bins.
+     */
+    size_t to_bins(std::vector<real>& bins) const{
+        size_t count = std::llround((to - from) / bin_size) + 1;
+        bins.assign(count, 0);
+
+        for(auto&& element : distribution){
+            long long index = std::llround((element.first - from) / bin_size);
+            index = std::max(0LL, std::min<long long>(index, count - 1));
+            bins[index] += element.second;
+        }
+        return count;
+    }
+
+    /**
+     * Returns the distribution with the bins summed into the coarser bins
+     * of new_bin_size (the value of a bin is from + k * new_bin_size).
+     */
+    Distribution coarsened(real new_bin_size) const{
+        Distribution<real> new_dist = Distribution<real>('m', new_bin_size);
+        new_dist.error_occurred = error_occurred;
+        if(error_occurred) return new_dist;
+
+        for(auto&& element : distribution){
+            new_dist.distribution[nearest_bin(element.first, new_bin_size)] += element.second;
+        }
+        new_dist.from = new_dist.distribution.begin()->first;
+        new_dist.to = new_dist.distribution.rbegin()->first;
+        return new_dist;
+    }
+
     /**
      * Normalizes distribution so that the sum equals 1.
      */
     void normalize(){
+        Trace_span span("normalize");
+        span.set_bins(distribution.size());
+
         real sum = 0;
         for(auto&& element : distribution){
             sum += element.second;
@@ -183,12 +329,12 @@ public:
     /**
      * Returns the number of bins of the distribution.
      */
-    unsigned int return_num_of_bins(){
+    size_t return_num_of_bins() const{
         return (to - from + bin_size) / bin_size;
     }
 
 
-    Distribution operator+(const Distribution &second){
+    Distribution operator+(const Distribution &second) const{
         Distribution<real> new_dist = Distribution<real>('m', bin_size);
         if(error_occurred || second.error_occurred){
             new_dist.error_occurred = true;
@@ -216,7 +362,7 @@ public:
         return new_dist;
     }
 
-    Distribution operator+(const real scalar){
+    Distribution operator+(const real scalar) const{
         Distribution<real> new_dist = Distribution<real>(*this);
         if(error_occurred){
             new_dist.error_occurred = true;
@@ -224,7 +370,7 @@ public:
         }
         new_dist.error_occurred = false;
 
-        std::map<real, real> new_map;
+        Bins new_map;
         for(auto&& element : distribution){
             new_map[element.first + scalar] = element.second;
         }
@@ -235,7 +381,7 @@ public:
         return new_dist;
     }
 
-    Distribution operator-(const Distribution &second){
+    Distribution operator-(const Distribution &second) const{
         Distribution<real> new_dist = Distribution<real>('m', bin_size);
         if(error_occurred || second.error_occurred){
             new_dist.error_occurred = true;
@@ -263,7 +409,7 @@ public:
         return new_dist;
     }
 
-    Distribution operator-(const real scalar){
+    Distribution operator-(const real scalar) const{
         Distribution<real> new_dist = Distribution<real>(*this);
         if(error_occurred){
             new_dist.error_occurred = true;
@@ -271,7 +417,7 @@ public:
         }
         new_dist.error_occurred = false;
 
-        std::map<real, real> new_map;
+        Bins new_map;
         for(auto&& element : distribution){
             new_map[element.first - scalar] = element.second;
         }
@@ -282,7 +428,7 @@ public:
         return new_dist;
     }
 
-    Distribution operator*(const Distribution &second){
+    Distribution operator*(const Distribution &second) const{
         Distribution<real> new_dist = Distribution<real>('m', bin_size);
         if(error_occurred || second.error_occurred){
             new_dist.error_occurred = true;
@@ -311,7 +457,7 @@ public:
         return new_dist;
     }
 
-    Distribution operator*(const real scalar){
+    Distribution operator*(const real scalar) const{
         Distribution<real> new_dist = Distribution<real>(*this);
         if(error_occurred){
             new_dist.error_occurred = true;
@@ -319,7 +465,7 @@ public:
         }
         new_dist.error_occurred = false;
 
-        std::map<real, real> new_map;
+        Bins new_map;
         for(auto&& element : distribution){
             new_map[nearest_bin(element.first * scalar)] = element.second;
         }
@@ -334,7 +480,7 @@ public:
      * divide_scalar_numerator (each element becomes (1/element)). Than we
      * multiply this new distribution with the first one.
      */
-    Distribution operator/(Distribution &second){
+    Distribution operator/(const Distribution &second) const{
         Distribution<real> prepared_for_division = second.divide_scalar_numerator(1);
         if(prepared_for_division.error_occurred || error_occurred){
             prepared_for_division.error_occurred = true;
@@ -345,7 +491,7 @@ public:
         return prepared_for_division * *this; // product
     }
 
-    Distribution operator/(const real scalar){
+    Distribution operator/(const real scalar) const{
         Distribution<real> new_dist = Distribution<real>(*this);
         if(error_occurred || scalar == 0){
             new_dist.error_occurred = true;
@@ -353,7 +499,7 @@ public:
         }
         new_dist.error_occurred = false;
 
-        std::map<real, real> new_map;
+        Bins new_map;
         for(auto&& element : distribution){
             new_map[nearest_bin(element.first / scalar)] = element.second;
         }
@@ -368,57 +514,76 @@ public:
     /**
      * Rounding of the number so that we avoid errors (mainly in indexing).
      */
-    real error_rounding(real number){
+    real error_rounding(real number) const{
         return round(number * DIVISION_ERROR) / DIVISION_ERROR;
     }
 
+    /**
+     * Sums the distribution into equally wide bins: bins[k] is the probability
+     * of the value get_from() + k * width, where width is returned.
+     * num_of_result_bins bins cover the whole range, -1 (or less than 1) keeps
+     * the bins of the distribution. Every element goes into the bin with
+     * the nearest integer index in one pass (no map and no floating keys).
+     * filled[k] says whether the bin belongs to the result - all bins for
+     * a given number of bins, only the bins with some element for -1.
+     */
+    real rebin(int num_of_result_bins, std::vector<real>& bins, std::vector<char>& filled) const{
+        bool keep_bins = num_of_result_bins < 1;
+        real width = keep_bins ? bin_size : (to - from) / (num_of_result_bins - 1);
+
+        // a single value or a single result bin
+        if(!(width > 0) || !std::isfinite(width)){
+            bins.assign(1, 0);
+            filled.assign(1, 1);
+            for(auto&& element : distribution) bins[0] += element.second;
+            return bin_size;
+        }
+
+        size_t count = keep_bins ? std::llround((to - from) / width) + 1 : num_of_result_bins;
+        bins.assign(count, 0);
+        filled.assign(count, !keep_bins);
+
+        for(auto&& element : distribution){
+            long long index = std::llround((element.first - from) / width);
+            index = std::max(0LL, std::min<long long>(index, count - 1));
+            bins[index] += element.second;
+            filled[index] = 1;
+        }
+        return width;
+    }
+
     /**
      * Prints the distribution.
      * If num_of_result_bins = -1 then print every bin we have in the distribution
      */
-    void print(std::ostream& ostr, int num_of_result_bins){
+    void print(std::ostream& ostr, int num_of_result_bins) const{
         if(error_occurred){
             std::cerr << "ERROR OCCURRED DURING COMPUTATION." << std::endl;
             return;
         }
 
-        ostr << "RESULT = " << from << " ~ " << to << std::endl;
-        ostr << std::endl;
-        real sum = 0;
-
-        real new_bin_size; // bin size might differ depending on the number of bins
-        if(num_of_result_bins == -1){
-            new_bin_size = bin_size;
-        }
-        else{
-            new_bin_size = (to - from) / (num_of_result_bins - 1);
-        }
-            
-        std::map<real, real> tmp; // temporary map in which we will sum the distribution
-
-        // For each element in the distribution we find the bin into which
-        // it sould go in the new shortened distribution. At first we just initialize it.
-        for(real i = 0; i < num_of_result_bins; i++) tmp[error_rounding(nearest_bin(i*new_bin_size + from, new_bin_size))] = 0;
+        ostr << "RESULT = " << from << " ~ " << to << '\n';
+        ostr << '\n';
 
-        // Now we sum it in the tmp distribution.
-        for(auto&& element : distribution){
-            tmp[error_rounding(nearest_bin(element.first, new_bin_size))] += element.second;
-        }
+        // bin size might differ depending on the number of bins
+        std::vector<real> bins;
+        std::vector<char> filled;
+        real new_bin_size = rebin(num_of_result_bins, bins, filled);
 
-        // Printing
-        for(auto element = tmp.rbegin(); element != tmp.rend(); ++element){
-            sum += element->second;
-            int hvezd = element->second / PRINT_BLOCK_PER_PROBABILITY;
-            ostr << std::right << std::setw(9) << element->first << "  ";
+        // Printing from the highest value
+        for(size_t k = bins.size(); k-- > 0;){
+            if(!filled[k]) continue;
+            int hvezd = bins[k] / PRINT_BLOCK_PER_PROBABILITY;
+            ostr << std::right << std::setw(9) << error_rounding(k * new_bin_size + from) << "  ";
             for(int h = 0; h <= hvezd; h++) ostr << "*";
-            ostr << std::endl;
+            ostr << '\n';
         }
     }
 
     /**
      * Makes operation: scalar / distribution.
      */
-    Distribution divide_scalar_numerator(real scalar){
+    Distribution divide_scalar_numerator(real scalar) const{
         Distribution<real> new_dist = Distribution<real>('m', bin_size);
         if(error_occurred){
             new_dist.error_occurred = true;
@@ -448,7 +613,7 @@ public:
  * Commutative arithmetic operation.
  */
 template <typename real>
-Distribution<real> operator+(const real scalar, Distribution<real> dist){
+Distribution<real> operator+(const real scalar, const Distribution<real>& dist){
     return dist + scalar;
 }
 
@@ -456,7 +621,7 @@ Distribution<real> operator+(const real scalar, Distribution<real> dist){
  * Commutative arithmetic operation.
  */
 template <typename real>
-Distribution<real> operator-(const real scalar, Distribution<real> dist){
+Distribution<real> operator-(const real scalar, const Distribution<real>& dist){
     return dist - scalar;
 }
 
@@ -464,7 +629,7 @@ Distribution<real> operator-(const real scalar, Distribution<real> dist){
  * Commutative arithmetic operation.
  */
 template <typename real>
-Distribution<real> operator*(const real scalar, Distribution<real> dist){
+Distribution<real> operator*(const real scalar, const Distribution<real>& dist){
     return dist * scalar;
 }
 
@@ -472,7 +637,7 @@ Distribution<real> operator*(const real scalar, Distribution<real> dist){
  * Divison - not commutative
  */
 template <typename real>
-Distribution<real> operator/(const real scalar, Distribution<real> dist){
+Distribution<real> operator/(const real scalar, const Distribution<real>& dist){
     return dist.divide_scalar_numerator(scalar);
 }
 
@@ -0,0 +1,336 @@
+#ifndef EMPIRICAL_HPP_
+#define EMPIRICAL_HPP_
+
+#include <charconv>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "distribution.hpp"
+#include "parallel.hpp"
+#include "result_format.hpp"
+
+/**
+ * Empirical distributions loaded from files (leaves `@path` in the expression).
+ *
+ * Files ending with `.bin` are binary: either a result written by
+ * `--format=bin` (a pre-binned histogram, its first record is used) or raw
+ * samples stored as doubles. Other files are text with one sample per line
+ * or `value,weight` per line (a histogram), lines that don't start with
+ * a number (i.e. a header) are skipped.
+ *
+ * The file is mapped into the memory and binned onto the grid in one pass,
+ * large files are split into parts binned by more threads. Values that are
+ * not finite are skipped. A file whose values span more bins than
+ * EMPIRICAL_MAX_BINS (or than fit into the memory budget) can't be loaded.
+ */
+
+// how many distributions (files and grids) are kept in the cache
+#define EMPIRICAL_CACHE_SIZE 64
+
+// files bigger than this are binned by more threads
+#define EMPIRICAL_PARALLEL_BYTES (1 << 24)
+
+// at most this many bins between the smallest and the largest value of a file
+#define EMPIRICAL_MAX_BINS (1 << 22)
+
+/**
+ * Histogram on a grid indexed by integers (bin k is the value k * bin_size),
+ * it grows to both sides as the values come, up to max_bins bins.
+ */
+template <typename real>
+struct Grid_histogram{
+    long long first = 0; // index of counts[0]
+    std::vector<real> counts;
+    size_t max_bins = EMPIRICAL_MAX_BINS;
+    bool too_wide = false; // some value didn't fit into max_bins
+
+    /**
+     * Adds the weight of the value. Returns bool (success), false when
+     * the histogram would span more than max_bins bins.
+     */
+    bool add(real value, real bin_size, real weight){
+        real position = value / bin_size;
+        if(!(std::abs(position) < 1e18)) return fail();
+        return add_index(std::llround(position), weight);
+    }
+
+    bool add_index(long long index, real weight){
+        if(counts.empty()){
+            if(max_bins == 0) return fail();
+            first = index;
+            counts.push_back(0);
+        }
+        else if(index < first){
+            if((unsigned long long)(first + (long long)counts.size() - index) > max_bins) return fail();
+            // grow at least twice to keep adding linear
+            size_t grow = std::min<size_t>(std::max<size_t>(first - index, counts.size()), max_bins - counts.size());
+            counts.insert(counts.begin(), grow, 0);
+            first -= grow;
+        }
+        else if(index >= first + (long long)counts.size()){
+            if((unsigned long long)(index - first) >= max_bins) return fail();
+            size_t needed = index - first + 1;
+            counts.resize(std::min<size_t>(std::max(needed, 2 * counts.size()), max_bins), 0);
+        }
+        counts[index - first] += weight;
+        return true;
+    }
+
+    bool merge(const Grid_histogram& second){
+        if(second.too_wide) return fail();
+        for(size_t i = 0; i < second.counts.size(); i++){
+            if(second.counts[i] != 0 && !add_index(second.first + i, second.counts[i])) return false;
+        }
+        return true;
+    }
+
+private:
+
+    bool fail(){
+        too_wide = true;
+        return false;
+    }
+};
+
+/**
+ * Mapped file (read only), unmapped by the destructor.
+ */
+class Mapped_file{
+
+    const char* data_pointer;
+    size_t length;
+
+public:
+
+    Mapped_file() : data_pointer(nullptr), length(0) {}
+
+    ~Mapped_file(){
+        if(data_pointer != nullptr) munmap((void*)data_pointer, length);
+    }
+
+    Mapped_file(const Mapped_file&) = delete;
+    Mapped_file& operator=(const Mapped_file&) = delete;
+
+    /**
+     * Returns bool (success), an empty file can't be mapped.
+     */
+    bool open(const std::string& path){
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+
+        struct stat info;
+        if(fstat(fd, &info) < 0 || info.st_size == 0){
+            close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mapped == MAP_FAILED) return false;
+
+        data_pointer = (const char*)mapped;
+        length = info.st_size;
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    const char* data() const{
+        return data_pointer;
+    }
+
+    size_t size() const{
+        return length;
+    }
+};
+
+/**
+ * Bins the text lines in [begin, end) - `value` or `value,weight`.
+ * Returns bool (success), false when the values span too many bins.
+ */
+template <typename real>
+bool bin_text(const char* begin, const char* end, real bin_size, Grid_histogram<real>& histogram){
+    const char* position = begin;
+    while(position < end){
+        const char* line_end = (const char*)memchr(position, '\n', end - position);
+        if(line_end == nullptr) line_end = end;
+
+        while(position < line_end && (*position == ' ' || *position == '\t')) position++;
+        double value;
+        std::from_chars_result parsed = std::from_chars(position, line_end, value);
+        if(parsed.ec == std::errc()){
+            double weight = 1;
+            position = parsed.ptr;
+            while(position < line_end && (*position == ' ' || *position == '\t' || *position == ',')) position++;
+            if(position < line_end && std::from_chars(position, line_end, weight).ec != std::errc()) weight = 1;
+            if(std::isfinite(value) && std::isfinite(weight) && weight > 0 &&
+               !histogram.add(value, bin_size, weight)) return false;
+        }
+        position = line_end + 1;
+    }
+    return true;
+}
+
+/**
+ * Bins the file onto the grid (bin_size). Returns bool (success)
+ */
+template <typename real>
+bool bin_file(const std::string& path, real bin_size, Grid_histogram<real>& histogram){
+    Mapped_file file;
+    if(!file.open(path)) return false;
+
+    // the histogram (and the distribution created from it) has to fit into the memory budget
+    if(Memory_budget::limit > 0) histogram.max_bins = std::min<size_t>(histogram.max_bins,
+                                                                        Memory_budget::available() / Distribution<real>::BIN_BYTES);
+    const char* data = file.data();
+    size_t size = file.size();
+    bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+
+    // a pre-binned histogram written by --format=bin
+    if(binary && size >= sizeof(Result_record_header) &&
+       ((const Result_record_header*)data)->magic == RESULT_MAGIC){
+        const Result_record_header* header = (const Result_record_header*)data;
+        if(header->status != RESULT_OK || !valid_result_record(header, size)) return false;
+        if(!std::isfinite(header->origin) || !std::isfinite(header->bin_size)) return false;
+
+        for(uint64_t i = 0; i < header->count; i++){
+            real probability;
+            switch(header->real_type){
+                case RESULT_REAL_FLOAT: probability = Result_file::bins<float>(header)[i]; break;
+                case RESULT_REAL_DOUBLE: probability = Result_file::bins<double>(header)[i]; break;
+                default: probability = Result_file::bins<long double>(header)[i]; break;
+            }
+            if(std::isfinite(probability) && probability > 0 &&
+               !histogram.add(header->origin + i * header->bin_size, bin_size, probability)) return false;
+        }
+        return !histogram.counts.empty();
+    }
+
+    // parts of the file binned by the threads (one part for small files)
+    unsigned int threads = size >= EMPIRICAL_PARALLEL_BYTES ? number_of_threads(0) : 1;
+    std::vector<Grid_histogram<real>> parts(threads);
+    for(auto&& part : parts) part.max_bins = histogram.max_bins;
+
+    if(binary){
+        const double* samples = (const double*)data;
+        size_t count = size / sizeof(double);
+        parallel_for(threads, threads, [&](size_t part, unsigned int){
+            for(size_t i = count * part / threads; i < count * (part + 1) / threads; i++){
+                if(std::isfinite(samples[i]) && !parts[part].add(samples[i], bin_size, 1)) return;
+            }
+        });
+    }
+    else{
+        // the parts start at the beginning of a line
+        std::vector<const char*> bounds(threads + 1, data + size);
+        bounds[0] = data;
+        for(unsigned int part = 1; part < threads; part++){
+            const char* start = data + size * part / threads;
+            const char* line_end = (const char*)memchr(start, '\n', data + size - start);
+            bounds[part] = line_end == nullptr ? data + size : line_end + 1;
+        }
+        parallel_for(threads, threads, [&](size_t part, unsigned int){
+            if(bounds[part] < bounds[part + 1]) bin_text(bounds[part], bounds[part + 1], bin_size, parts[part]);
+        });
+    }
+
+    for(auto&& part : parts){
+        if(!histogram.merge(part)) return false;
+    }
+    return !histogram.counts.empty();
+}
+
+/**
+ * Cache of the empirical distributions shared by the whole program.
+ * A file is binned once for each grid, the entry is used while the file
+ * has the same modification time and size. When the cache is full,
+ * it is cleared.
+ */
+template <typename real>
+class Empirical_cache{
+
+    struct Entry{
+        struct timespec modified = {0, 0};
+        off_t size = -1;
+        std::map<real, Distribution<real>> grids; // bin_size -> distribution
+    };
+
+    std::map<std::string, Entry> files;
+    size_t count; // number of cached distributions
+    size_t capacity;
+    std::mutex mutex;
+
+    Empirical_cache(size_t capacity) : count(0), capacity(capacity) {}
+
+public:
+
+    static Empirical_cache& instance(){
+        static Empirical_cache cache(EMPIRICAL_CACHE_SIZE);
+        return cache;
+    }
+
+    /**
+     * Returns the distribution from the file binned onto the grid, its
+     * error_occurred is set when the file can't be read or has no values.
+     */
+    std::unique_ptr<Distribution<real>> get(const std::string& path, real bin_size){
+        struct stat info;
+        if(stat(path.c_str(), &info) < 0) return failed(bin_size);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto file = files.find(path);
+            if(file != files.end() && same(file->second, info)){
+                auto grid = file->second.grids.find(bin_size);
+                if(grid != file->second.grids.end()) return std::make_unique<Distribution<real>>(grid->second);
+            }
+        }
+
+        // the file is binned outside of the lock, so the threads don't wait
+        Grid_histogram<real> histogram;
+        if(!bin_file(path, bin_size, histogram)){
+            if(histogram.too_wide){
+                std::cerr << "ERROR: VALUES OF THE FILE " << path << " SPAN MORE THAN " << histogram.max_bins
+                          << " BINS OF SIZE " << bin_size << " (USE A BIGGER BIN SIZE)." << std::endl;
+            }
+            return failed(bin_size);
+        }
+        auto created = std::make_unique<Distribution<real>>(histogram.counts, histogram.first, bin_size);
+        if(created->error_occurred) return created;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(count >= capacity){
+            files.clear();
+            count = 0;
+        }
+        Entry& entry = files[path];
+        if(!same(entry, info)){
+            count -= entry.grids.size();
+            entry.grids.clear();
+            entry.modified = info.st_mtim;
+            entry.size = info.st_size;
+        }
+        if(entry.grids.emplace(bin_size, *created).second) count++;
+        return created;
+    }
+
+private:
+
+    static bool same(const Entry& entry, const struct stat& info){
+        return entry.size == info.st_size && entry.modified.tv_sec == info.st_mtim.tv_sec &&
+               entry.modified.tv_nsec == info.st_mtim.tv_nsec;
+    }
+
+    static std::unique_ptr<Distribution<real>> failed(real bin_size){
+        auto distribution = std::make_unique<Distribution<real>>('m', bin_size);
+        distribution->error_occurred = true;
+        return distribution;
+    }
+};
+
+#endif
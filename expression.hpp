@@ -2,8 +2,20 @@
 #define EXPRESSION_HPP_
 
 #include <stack>
+#include <memory>
 #include "distribution.hpp"
+#include "operators.hpp"
+#include "expression_tree.hpp"
+#include "cache.hpp"
+#include "empirical.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "hwcounters.hpp"
+#include "cost.hpp"
 #include <set>
+#include <limits>
+#include <chrono>
 #include <map>
 
 // #define DEBUG_BUILD
@@ -20,13 +32,18 @@
 #endif
 
 /**
- * Whether char[] contains a char or not.
+ * Whether the character is an operator (see Operator_registry).
  */
-bool contains(const char* array, char character){
-    for(size_t i = 0; array[i] != 0; i++){
-        if(array[i] == character) return true;
-    }
-    return false;
+template <typename real>
+bool is_operator_char(char character){
+    return Operator_registry<real>::find(character) != nullptr;
+}
+
+/**
+ * Whether the character can be a part of a variable name.
+ */
+bool is_identifier_char(char character){
+    return std::isalnum(character) || character == '_';
 }
 
 /**
@@ -48,32 +65,43 @@ class Token{
 
 public:
 
-    static const char operators[];
-    static const char arithmetic_operators[];
-    static const char distribution_operators[];
-
-    bool get_is_operator(){
+    bool get_is_operator() const{
         return is_operator;
     }
 
+    bool get_is_number() const{
+        return is_number;
+    }
+
+    real get_number() const{
+        return number;
+    }
+
+    /**
+     * Returns the distribution or nullptr when the token isn't a distribution.
+     */
+    const Distribution<real>* get_distribution() const{
+        return is_distribution ? dist_ptr.get() : nullptr;
+    }
+
     char get_op(){
         return op;
     }
 
     bool error_occurred; // public flag indicating that something wrong happened
 
-    Token() : number(0), is_number(true), is_operator(false), is_distribution(false), error_occurred(false) {}
+    Token() : number(0), op(0), priority(0), is_number(true), is_operator(false), is_distribution(false), error_occurred(false) {}
 
-    Token(std::unique_ptr<Distribution<real>> ptr) : dist_ptr(std::move(ptr)), is_number(false),
+    Token(std::unique_ptr<Distribution<real>> ptr) : dist_ptr(std::move(ptr)), number(0), op(0), priority(0), is_number(false),
                                                     is_operator(false), is_distribution(true){
         error_occurred = dist_ptr->error_occurred;
     }
 
-    Token(real number) : number(number), is_number(true),
+    Token(real number) : number(number), op(0), priority(0), is_number(true),
                         is_operator(false), is_distribution(false),
                         error_occurred(false) {}
 
-    Token(char op, int priority) : op(op), priority(priority), is_number(false),
+    Token(char op, int priority) : number(0), op(op), priority(priority), is_number(false),
                                     is_operator(true), is_distribution(false),
                                     error_occurred(false) {}
 
@@ -115,19 +143,41 @@ public:
 
     }
 
+    /**
+     * Returns a copy of the token (Token can only be moved, because copying
+     * a distribution is expensive).
+     */
+    Token<real> clone(){
+        if(is_distribution) return Token<real>(std::make_unique<Distribution<real>>(*dist_ptr));
+        if(is_operator) return Token<real>(op, priority);
+
+        Token<real> result(number);
+        result.error_occurred = error_occurred;
+        return result;
+    }
+
+    /**
+     * Sets the bin_size of the stored distribution (see Distribution::set_bin_size).
+     */
+    void set_bin_size(real bin_size){
+        if(is_distribution) dist_ptr->set_bin_size(bin_size);
+    }
+
     /**
      * Prints a token.
      */
-    void print(std::ostream& ostr, int num_of_result_bins){
+    void print(std::ostream& ostr, int num_of_result_bins) const{
         if(is_number){
-            ostr << number << std::endl;
+            ostr << number << '\n';
             return;
         }
         if(is_operator){
-            ostr << op << std::endl;
+            ostr << op << '\n';
             return;
         }
         if(is_distribution){
+            Trace_span span("print");
+            span.set_bins(num_of_bins());
             dist_ptr->print(ostr, num_of_result_bins);
         }
     }
@@ -136,98 +186,176 @@ public:
      * Gets two tokens and operation (+ necessary) other info) and returns Token<real>,
      * where error_occurred is set when an error occurred.
      * 
-     * For distribution operators create a distribution.
-     * 
-     * Otherwise we perform arithmetic operations.
-     * 
-     * Number op Number ... special case
-     * Otherwise we just perform the operation
+     * The operator is looked up in the Operator_registry and the kernel for
+     * the types of the operands is called:
+     *   - distribution operators create a distribution from two numbers
+     *   - arithmetic operators have a kernel for number op number,
+     *     dist op number, number op dist and dist op dist
      * 
      * Returns a Token
      */
-    static Token<real> operation(Token<real>&& left, Token<real>&& right, char operation, real bin_size, real std_deviation_quotient){
+    static Token<real> operation(const Token<real>& left, const Token<real>& right, char operation, real bin_size, real std_deviation_quotient,
+                                 Leaf_cache<real>* leaf_cache = nullptr){
+        if(!Operation_stats::enabled && !Trace::enabled && !Hardware_counters::enabled)
+            return compute(left, right, operation, bin_size, std_deviation_quotient, leaf_cache);
+
+        char name[] = "operator ?";
+        name[sizeof(name) - 2] = operation;
+        Trace_span span(name);
+
+        size_t bytes = Memory_budget::allocated_bytes;
+        Counter_values before, after;
+        auto start = std::chrono::steady_clock::now();
+        if(Hardware_counters::enabled) Counter_group::of_thread().read_values(before);
+        Token<real> result = compute(left, right, operation, bin_size, std_deviation_quotient, leaf_cache);
+        if(Hardware_counters::enabled) Counter_group::of_thread().read_values(after);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        span.set_bins(result.num_of_bins());
+        if(Operation_stats::enabled){
+            Operation_stats::instance().record({operation, left.is_distribution, right.is_distribution, result.is_distribution,
+                                                left.num_of_bins(), right.num_of_bins(), result.num_of_bins(),
+                                                seconds, Memory_budget::allocated_bytes - bytes});
+        }
+        if(Hardware_counters::enabled){
+            Hardware_counters::instance().record(step_kind(left, right, operation), result.num_of_bins(), before, after);
+        }
+        return result;
+    }
+
+private:
+
+    /**
+     * Kind of the step for --hwcounters: "leaf ~" or "dist * number".
+     */
+    static std::string step_kind(const Token<real>& left, const Token<real>& right, char operation){
+        const Operator<real>* op = Operator_registry<real>::find(operation);
+        if(op != nullptr && op->leaf != nullptr) return std::string("leaf ") + operation;
+        return std::string(left.is_distribution ? "dist " : "number ") + operation +
+               (right.is_distribution ? " dist" : " number");
+    }
+
+    /**
+     * Number of stored bins of a distribution, 0 for a number.
+     */
+    size_t num_of_bins() const{
+        return is_distribution && dist_ptr != nullptr ? dist_ptr->get_bins().size() : 0;
+    }
+
+    /**
+     * Computes the operation (see operation()).
+     */
+    static Token<real> compute(const Token<real>& left, const Token<real>& right, char operation, real bin_size, real std_deviation_quotient,
+                               Leaf_cache<real>* leaf_cache){
         DEBUG2(left.number, right.number);
-        // Create a distribution from 2 numbers (from .. to)
-        if(contains(distribution_operators, operation) && 
-           left.is_number && right.is_number){
-            
-            Token<real> result(std::make_unique<Distribution<real>>(operation, left.number, right.number, bin_size, std_deviation_quotient));
-            if(result.dist_ptr->error_occurred) result.error_occurred = true;
+        const Operator<real>* op = Operator_registry<real>::find(operation);
+
+        // unknown operator, left or right is an operator or an error => error
+        if(op == nullptr || left.is_operator || right.is_operator ||
+           left.error_occurred || right.error_occurred){
+            Token<real> result(0);
+            result.error_occurred = true;
             return result;
-            
         }
-        // Perform an arithmetic operation
-        else if(contains(arithmetic_operators, operation)){
-            if(left.is_number && right.is_number){
-
-                // Define macro so that we don't need to copy code
-                #define NUMBER_OPERATIONS(OPERATOR) \
-                    if(operation == #OPERATOR[0]){ \
-                        DEBUG2("Operace (num a num", #OPERATOR); \
-                        if((#OPERATOR[0] == '/' && right.number == 0) || right.error_occurred || left.error_occurred){ \
-                            Token<real> result(0); \
-                            result.error_occurred = true; \
-                            return result; \
-                        } \
-                        Token<real> result(left.number OPERATOR right.number); \
-                        return result; \
-                    } 
-
-                NUMBER_OPERATIONS(+);
-                NUMBER_OPERATIONS(-);
-                NUMBER_OPERATIONS(*);
-                NUMBER_OPERATIONS(/);
+
+        // Create a distribution from 2 numbers (from .. to)
+        if(op->leaf != nullptr){
+            if(!left.is_number || !right.is_number){
+                Token<real> result(0);
+                result.error_occurred = true;
+                return result;
             }
-            else if((left.is_number || left.is_distribution) && (right.is_number || right.is_distribution)){
-
-                #define MIXED_OPERATIONS(OPERATOR) \
-                    \
-                    if(operation == #OPERATOR[0]){ \
-                        DEBUG2("Operace (num a dist) ", #OPERATOR); \
-                        if(right.error_occurred || left.error_occurred){ \
-                            Token<real> result(0); \
-                            result.error_occurred = true; \
-                            return result; \
-                        } \
-                        Token<real> result; \
-                        if(left.is_distribution && right.is_distribution) \
-                            result = std::make_unique<Distribution<real>>(*left.dist_ptr OPERATOR *right.dist_ptr); \
-                        else if(left.is_distribution && right.is_number) \
-                            result = std::make_unique<Distribution<real>>(*left.dist_ptr OPERATOR right.number); \
-                        else \
-                            result = std::make_unique<Distribution<real>>(left.number OPERATOR *right.dist_ptr); \
-                        if(result.dist_ptr->error_occurred) result.error_occurred = true; \
-                        return result; \
-                    } 
-
-                MIXED_OPERATIONS(+);
-                MIXED_OPERATIONS(-);
-                MIXED_OPERATIONS(*);
-                MIXED_OPERATIONS(/);
-            }                
-            else{ // left or right is an operator => error
+            real grid = bin_size;
+            if(!fitting_grid(operation, (right.number - left.number) / bin_size + 1, bin_size, grid)){
                 Token<real> result(0);
                 result.error_occurred = true;
                 return result;
             }
+
+            Trace_span span("leaf");
+            Token<real> result = leaf_cache != nullptr ?
+                Token<real>(leaf_cache->get(operation, left.number, right.number, grid, std_deviation_quotient)) :
+                Token<real>(std::make_unique<Distribution<real>>(op->leaf(left.number, right.number, grid, std_deviation_quotient)));
+            span.set_bins(result.num_of_bins());
+            return result;
         }
-        else{ // left or right is an operator => error
+
+        // Perform an arithmetic operation
+        if(left.is_number && right.is_number){
+            Token<real> result(0);
+            result.error_occurred = !op->number_number(left.number, right.number, result.number);
+            return result;
+        }
+
+        // the result has at most as many bins as its interval and as the pairs of the operands
+        real grid = bin_size;
+        Interval<real> support = op->support(left.interval(), right.interval());
+        real estimated_bins = std::min<real>((support.hi - support.lo) / bin_size + 1,
+                                             (real)std::max<size_t>(left.num_of_bins(), 1) * std::max<size_t>(right.num_of_bins(), 1));
+        if(!fitting_grid(operation, estimated_bins, bin_size, grid)){
             Token<real> result(0);
             result.error_occurred = true;
             return result;
         }
+
+        // operands are coarsened when the result wouldn't fit into the memory budget
+        const Distribution<real>* a = left.get_distribution();
+        const Distribution<real>* b = right.get_distribution();
+        std::unique_ptr<Distribution<real>> coarse_a, coarse_b;
+        if(grid != bin_size){
+            if(a != nullptr){
+                coarse_a = std::make_unique<Distribution<real>>(a->coarsened(grid));
+                a = coarse_a.get();
+            }
+            if(b != nullptr){
+                coarse_b = std::make_unique<Distribution<real>>(b->coarsened(grid));
+                b = coarse_b.get();
+            }
+        }
+
+        if(a != nullptr && b != nullptr)
+            return Token<real>(std::make_unique<Distribution<real>>(op->dist_dist(*a, *b)));
+        if(a != nullptr)
+            return Token<real>(std::make_unique<Distribution<real>>(op->dist_number(*a, right.number)));
+        return Token<real>(std::make_unique<Distribution<real>>(op->number_dist(left.number, *b)));
+    }
+
+    /**
+     * Interval of the values of the token (see Operator::support).
+     */
+    Interval<real> interval() const{
+        if(is_distribution) return {dist_ptr->get_from(), dist_ptr->get_to(), false};
+        return {number, number, true};
+    }
+
+    /**
+     * Finds the bin size (a multiple of bin_size) with which a result of
+     * estimated_bins bins fits into the memory budget. The result may take
+     * at most half of the available memory, the rest is left for the
+     * coarsened operands. A coarser grid is reported.
+     * Returns false when not even MEMORY_MIN_BINS bins fit (or there is no
+     * budget left), then the operation fails instead of the whole program.
+     */
+    static bool fitting_grid(char operation, real estimated_bins, real bin_size, real& grid){
+        grid = bin_size;
+        if(Memory_budget::limit == 0 || !std::isfinite(estimated_bins)) return true;
+
+        real allowed_bins = (real)(Memory_budget::available() / 2 / Distribution<real>::BIN_BYTES);
+        if(estimated_bins <= allowed_bins) return true;
+        if(allowed_bins < MEMORY_MIN_BINS){
+            std::cerr << "ERROR: MEMORY LIMIT EXCEEDED (" << Memory_budget::live_bytes << " B OF "
+                      << Memory_budget::limit << " B USED), OPERATOR " << operation << " NOT COMPUTED." << std::endl;
+            return false;
+        }
+
+        grid = bin_size * std::ceil(estimated_bins / allowed_bins);
+        std::cerr << "WARNING: MEMORY LIMIT - OPERATOR " << operation << " COMPUTED WITH BIN SIZE " << grid
+                  << " INSTEAD OF " << bin_size << " (ABOUT " << (size_t)estimated_bins << " BINS DON'T FIT)." << std::endl;
         return true;
     }
 
 };
 
-template <typename real>
-const char Token<real>::operators[] = "+-*/~nu";
-template <typename real>
-const char Token<real>::arithmetic_operators[] = "+-*/";
-template <typename real>
-const char Token<real>::distribution_operators[] = "~nu";
-
 /**
  * Class representing an expression.
  * Can parse and evaluate the expression.
@@ -236,50 +364,65 @@ const char Token<real>::distribution_operators[] = "~nu";
 template <typename real>
 class Expression{
 
-    std::stack<Token<real>> prefix_stack;
-    std::stack<Token<real>> infix_help_stack;
+    // vectors keep their buffers when the expression is reset
+    std::stack<Token<real>, std::vector<Token<real>>> prefix_stack;
+    std::stack<Token<real>, std::vector<Token<real>>> infix_help_stack;
+
+    // with lazy evaluation the expression is first parsed into the tree
+    Expression_tree<real> tree;
+
+    // values of variables defined by `let name = expression;`
+    std::map<std::string, Token<real>> symbols;
 
 public:
 
     real bin_size;
     real std_deviation_quotient;
+    bool lazy;
+
+    // leaf distributions are taken from the cache (if set)
+    Leaf_cache<real>* leaf_cache = nullptr;
+
+    // evaluated distributions are stored and loaded (if set), the expression
+    // is then parsed into the tree as with lazy evaluation
+    const Snapshot_store<real>* snapshots = nullptr;
 
-    Expression(){}
+    // the cost of the expression is estimated before the evaluation and
+    // checked against the limit (if set), the expression is then parsed
+    // into the tree as with lazy evaluation
+    const Cost_limit* cost_limit = nullptr;
 
-    Expression(real bin_size, real std_deviation_quotient) : bin_size(bin_size), 
-                                std_deviation_quotient(std_deviation_quotient){}
+    Expression() : lazy(false) {}
+
+    Expression(real bin_size, real std_deviation_quotient, bool lazy = false) : bin_size(bin_size), 
+                                std_deviation_quotient(std_deviation_quotient), lazy(lazy) {}
+
+    /**
+     * Prepares the expression for parsing of another input. Stacks and
+     * variables are cleared, but the allocated buffers are kept.
+     */
+    void reset(){
+        while(!prefix_stack.empty()) prefix_stack.pop();
+        while(!infix_help_stack.empty()) infix_help_stack.pop();
+        tree.clear();
+        symbols.clear();
+    }
+
+    /**
+     * Returns the tree parsed with lazy evaluation (before evaluate() is called).
+     */
+    Expression_tree<real>& get_tree(){
+        return tree;
+    }
 
     /**
      * Returns priority of an operator.
      */
     int return_priority(char op){
-        switch(op){
-            case '(': // special operator (opening bracket) .. only for infix to postfix
-                return 0;
-                break;
-            case '+':
-                return 1;
-                break;
-            case '-':
-                return 1;
-                break;
-            case '*':
-                return 2;
-                break;
-            case '/':
-                return 2;
-                break;
-            case '~':
-                return 3;
-                break;
-            case 'n':
-                return 3;
-                break;
-            case 'u':
-                return 3;
-                break;
-        }
-        return -1;
+        if(op == '(') return 0; // special operator (opening bracket) .. only for infix to postfix
+
+        const Operator<real>* registered = Operator_registry<real>::find(op);
+        return registered == nullptr ? -1 : registered->priority;
     }
 
     /**
@@ -298,15 +441,16 @@ public:
      */
     bool process_operator(char op){
 
-        // operators are binary
-        if(prefix_stack.size() >= 2){
+        if(in_tree()) return tree.add_operator(op);
+
+        if(prefix_stack.size() >= (size_t)Operator_registry<real>::find(op)->arity){
             Token<real> right(std::move(prefix_stack.top()));
             prefix_stack.pop();
             Token<real> left(std::move(prefix_stack.top()));
             prefix_stack.pop();
 
             // perform operation
-            Token<real> result = Token<real>::operation(std::move(left), std::move(right), op, bin_size, std_deviation_quotient);
+            Token<real> result = Token<real>::operation(left, right, op, bin_size, std_deviation_quotient, leaf_cache);
             prefix_stack.emplace(std::move(result));
             if(prefix_stack.top().error_occurred){
                 return false;
@@ -318,31 +462,227 @@ public:
         return true;
     }
 
+    /**
+     * Puts a number on the stack (or into the tree with lazy evaluation).
+     * Implicit numbers are the zeros inserted before a unary minus.
+     */
+    void process_number(real number, bool implicit = false){
+        if(in_tree()) tree.add_number(number, implicit);
+        else prefix_stack.emplace(number);
+    }
+
+    /**
+     * Whether the index-th number of the postfix input is an implicit zero
+     * (see parse_postfix_input).
+     */
+    static bool is_implicit(const std::vector<char>* implicit_zeros, size_t index){
+        return implicit_zeros != nullptr && index < implicit_zeros->size() && (*implicit_zeros)[index];
+    }
+
+    /**
+     * Puts the empirical distribution from the file on the stack (or into
+     * the tree with lazy evaluation), see empirical.hpp.
+     * Returns bool (success), false when the file can't be loaded.
+     */
+    bool process_file(const std::string& path){
+        if(in_tree()){
+            tree.add_file(path);
+            return true;
+        }
+
+        prefix_stack.emplace(Empirical_cache<real>::instance().get(path, bin_size));
+        return !prefix_stack.top().error_occurred;
+    }
+
+    /**
+     * Reads a file reference `@path` starting at input_string[i], the path
+     * ends with a space or a parenthesis.
+     * Returns the reference including '@' or an empty string when there is none.
+     */
+    std::string read_file_reference(const std::string& input_string, size_t i){
+        if(input_string[i] != '@') return "";
+
+        size_t end = i + 1;
+        while(end < input_string.length() && input_string[end] != ' ' &&
+              input_string[end] != '(' && input_string[end] != ')') end++;
+        if(end == i + 1) return "";
+        return input_string.substr(i, end - i);
+    }
+
+    /**
+     * Puts a copy of the value of a variable on the stack (or a reference
+     * into the tree with lazy evaluation).
+     * Every reference is an independent copy of the same distribution.
+     * Returns bool (success), false for an unknown variable.
+     */
+    bool process_identifier(const std::string& name){
+        if(in_tree()) return tree.add_reference(name);
+
+        auto symbol = symbols.find(name);
+        if(symbol == symbols.end()) return false;
+        prefix_stack.emplace(symbol->second.clone());
+        return true;
+    }
+
+    /**
+     * Reads a variable name starting at input_string[i]. Letters that are
+     * operators (i.e. 'u' and 'n') are not variables when they stand alone
+     * or are followed by a number (`3 u5` is `3 u 5`).
+     * Returns the name or an empty string when there is no variable.
+     */
+    std::string read_identifier(const std::string& input_string, size_t i){
+        if(!std::isalpha(input_string[i]) && input_string[i] != '_') return "";
+        if(is_operator_char<real>(input_string[i]) && i + 1 < input_string.length() &&
+           (std::isdigit(input_string[i + 1]) || input_string[i + 1] == '.')) return "";
+
+        size_t end = i;
+        while(end < input_string.length() && is_identifier_char(input_string[end])) end++;
+        if(end - i == 1 && is_operator_char<real>(input_string[i])) return "";
+        return input_string.substr(i, end - i);
+    }
+
+    /**
+     * Parses a binding `let name = expression` (written in the same notation
+     * as the rest of the input), evaluates the expression and saves it
+     * as the variable.
+     * Returns bool (success)
+     */
+    bool process_binding(const std::string& binding, bool postfix){
+        size_t i = binding.find_first_not_of(' ');
+        if(i == std::string::npos || binding.compare(i, 4, "let ") != 0) return false;
+        i = binding.find_first_not_of(' ', i + 4);
+        if(i == std::string::npos) return false;
+
+        std::string name = read_identifier(binding, i);
+        if(name.empty() || name == "let") return false;
+        i = binding.find_first_not_of(' ', i + name.length());
+        if(i == std::string::npos || binding[i] != '=') return false;
+
+        std::stringstream definition(binding.substr(i + 1));
+        bool success = postfix ? parse_postfix_input(definition) : parse_infix_input(definition);
+        if(!success) return false;
+
+        if(in_tree()) return tree.bind(name);
+
+        if(prefix_stack.size() != 1 || prefix_stack.top().get_is_operator() ||
+           prefix_stack.top().error_occurred) return false;
+        symbols[name] = std::move(prefix_stack.top());
+        prefix_stack.pop();
+        return true;
+    }
+
+    /**
+     * Parses the input: zero or more bindings `let name = expression;`
+     * followed by the expression itself. Both are written in postfix
+     * or infix notation.
+     * Returns bool (success)
+     */
+    bool parse_input(std::stringstream& input, bool postfix){
+        Trace_span span("parse");
+        std::string input_string;
+        std::getline(input, input_string);
+
+        size_t begin = 0;
+        size_t end;
+        while((end = input_string.find(';', begin)) != std::string::npos){
+            if(!process_binding(input_string.substr(begin, end - begin), postfix)) return false;
+            begin = end + 1;
+        }
+
+        std::stringstream expression(input_string.substr(begin));
+        return postfix ? parse_postfix_input(expression) : parse_infix_input(expression);
+    }
+
+    /**
+     * Whether the expression is parsed into the tree (lazy evaluation or
+     * the snapshot store) instead of being evaluated during parsing.
+     */
+    bool in_tree() const{
+        return lazy || snapshots != nullptr || cost_limit != nullptr;
+    }
+
+    /**
+     * With lazy evaluation computes the parsed tree so that the result has
+     * the resolution needed for printing num_of_result_bins bins (with
+     * the snapshot store only, every node is computed with bin_size).
+     * Otherwise the expression was already evaluated during parsing.
+     * Returns bool (success)
+     */
+    bool evaluate(int num_of_result_bins){
+        if(!in_tree()) return true;
+
+        if(tree.root() < 0) return false;
+        plan(num_of_result_bins, bin_size);
+        if(cost_limit != nullptr && !within_cost_limit(num_of_result_bins)){
+            tree.clear();
+            symbols.clear();
+            return false;
+        }
+        prefix_stack.emplace(tree.evaluate(std_deviation_quotient, leaf_cache, snapshots));
+        tree.clear();
+        symbols.clear();
+
+        return !prefix_stack.top().error_occurred;
+    }
+
+    /**
+     * Prints the estimated cost of the parsed expression (every node and
+     * the totals) instead of evaluating it (--explain).
+     * Returns bool (success)
+     */
+    bool explain(std::ostream& ostr, int num_of_result_bins){
+        if(!in_tree() || tree.root() < 0) return false;
+
+        tree.compute_supports(bin_size);
+        plan(num_of_result_bins, bin_size);
+        Cost_estimate<real>::estimate(tree).print(ostr, tree);
+        tree.clear();
+        symbols.clear();
+        return true;
+    }
+
     /**
      * Parsing postfix based on states.
      * Description in program documentation.
-     * Input: stringstream
+     * Input: stringstream, flags of the numbers (in their order) that are
+     *        zeros inserted before a unary minus by parse_infix_input()
      * Returns: bool (success)
      */
-    bool parse_postfix_input(std::stringstream& input){
+    bool parse_postfix_input(std::stringstream& input, const std::vector<char>* implicit_zeros = nullptr){
         std::string input_string;
         std::getline(input, input_string);
         std::stringstream new_number;
         real number;
+        size_t numbers = 0; // numbers read so far
 
         int state = 1;
 
         for(long unsigned int i = 0; i < input_string.length(); i++){
 
             if(state == 1){ // first state - nothing read
+                std::string name = read_identifier(input_string, i);
+
                 // digit or '.'
                 if(std::isdigit(input_string[i]) || input_string[i] == '.'){
                     new_number << input_string[i];
                     state++;
                     continue;
                 }
+                // variable
+                else if(!name.empty()){
+                    if(!process_identifier(name)) return false;
+                    i += name.length() - 1;
+                    continue;
+                }
+                // empirical distribution from a file
+                else if(input_string[i] == '@'){
+                    std::string reference = read_file_reference(input_string, i);
+                    if(reference.empty() || !process_file(reference.substr(1))) return false;
+                    i += reference.length() - 1;
+                    continue;
+                }
                 // operator
-                else if(contains(Token<real>::operators, input_string[i])){
+                else if(is_operator_char<real>(input_string[i])){
                     if(!process_operator(input_string[i])) return false;
                     continue;
                 }
@@ -362,10 +702,10 @@ public:
                     continue;
                 }
                 // operator
-                else if(contains(Token<real>::operators, input_string[i])){
+                else if(is_operator_char<real>(input_string[i])){
                     new_number >> number;
                     new_number.clear();
-                    prefix_stack.emplace(number);
+                    process_number(number, is_implicit(implicit_zeros, numbers++));
                     if(!process_operator(input_string[i])) return false;
                     state = 1;
                     continue;
@@ -374,7 +714,7 @@ public:
                 else if(input_string[i] == ' '){
                     new_number >> number;
                     new_number.clear();
-                    prefix_stack.emplace(number);
+                    process_number(number, is_implicit(implicit_zeros, numbers++));
                     state = 1;
                     continue;
                 }
@@ -389,10 +729,10 @@ public:
                     continue;
                 }
                 // operator
-                else if(contains(Token<real>::operators, input_string[i])){
+                else if(is_operator_char<real>(input_string[i])){
                     new_number >> number;
                     new_number.clear();
-                    prefix_stack.emplace(number);
+                    process_number(number, is_implicit(implicit_zeros, numbers++));
                     if(!process_operator(input_string[i])) return false;
                     state = 1;
                     continue;
@@ -401,7 +741,7 @@ public:
                 else if(input_string[i] == ' '){
                     new_number >> number;
                     new_number.clear();
-                    prefix_stack.emplace(number);
+                    process_number(number, is_implicit(implicit_zeros, numbers++));
                     state = 1;
                     continue;
                 }
@@ -411,7 +751,7 @@ public:
         // if we started to read a number, get the last number
         if(state > 1){
             new_number >> number;
-            prefix_stack.emplace(number);
+            process_number(number, is_implicit(implicit_zeros, numbers++));
         }
         return true;
     }
@@ -521,16 +861,21 @@ public:
         }
 
         // Insert zeros where necessary (but we do it from end as the length
-        // of the string changes)
+        // of the string changes). Their final positions are kept, so that
+        // the zeros can be told apart from the numbers written in the input.
+        std::set<size_t> zero_positions;
         while(!positions.empty()){
             size_t position = positions.top();
             positions.pop();
             input_string.insert(input_string.begin() + position, '0');
+            zero_positions.insert(position + positions.size());
         }
+        std::vector<char> implicit_zeros;
 
         std::stringstream new_number;
         real number;
         std::stringstream output; // this will be output for postfix
+        output.precision(std::numeric_limits<real>::max_digits10); // numbers are read back exactly
 
         state = 1;
 
@@ -540,14 +885,31 @@ public:
         for(long unsigned int i = 0; i < input_string.length(); i++){
 
             if(state == 1){ // first state - nothing read
+                std::string name = read_identifier(input_string, i);
+
                 // digit or '.'
                 if(std::isdigit(input_string[i]) || input_string[i] == '.'){
                     new_number << input_string[i];
+                    implicit_zeros.push_back(zero_positions.count(i) > 0);
                     state++;
                     continue;
                 }
+                // variable - it is resolved during the postfix parsing
+                else if(!name.empty()){
+                    output << " " << name << " ";
+                    i += name.length() - 1;
+                    continue;
+                }
+                // file - it is loaded during the postfix parsing
+                else if(input_string[i] == '@'){
+                    std::string reference = read_file_reference(input_string, i);
+                    if(reference.empty()) return false;
+                    output << " " << reference << " ";
+                    i += reference.length() - 1;
+                    continue;
+                }
                 // operator
-                else if(contains(Token<real>::operators, input_string[i]) || input_string[i] == '(' || input_string[i] == ')'){
+                else if(is_operator_char<real>(input_string[i]) || input_string[i] == '(' || input_string[i] == ')'){
                     if(!process_operator_infix(input_string[i], output)) return false;
                     continue;
                 }
@@ -567,7 +929,7 @@ public:
                     continue;
                 }
                 // operator
-                else if(contains(Token<real>::operators, input_string[i]) || input_string[i] == '(' || input_string[i] == ')'){
+                else if(is_operator_char<real>(input_string[i]) || input_string[i] == '(' || input_string[i] == ')'){
                     new_number >> number;
                     new_number.clear();
                     output << " " << number << " ";
@@ -594,7 +956,7 @@ public:
                     continue;
                 }
                 // operator
-                else if(contains(Token<real>::operators, input_string[i]) || input_string[i] == '(' || input_string[i] == ')'){
+                else if(is_operator_char<real>(input_string[i]) || input_string[i] == '(' || input_string[i] == ')'){
                     new_number >> number;
                     new_number.clear();
                     output << " " << number << " ";
@@ -624,7 +986,17 @@ public:
             infix_help_stack.pop(); // and pop the operator
         }
 
-        return parse_postfix_input(output);
+        return parse_postfix_input(output, &implicit_zeros);
+    }
+
+    /**
+     * Returns the result (that is the last Token in the stack) or nullptr
+     * when there is no valid result.
+     */
+    const Token<real>* result(){
+        if(prefix_stack.size() != 1) return nullptr;
+        if(prefix_stack.top().get_is_operator() || prefix_stack.top().error_occurred) return nullptr;
+        return &prefix_stack.top();
     }
 
     /**
@@ -644,6 +1016,48 @@ public:
         }
         return true;
     }
+
+private:
+
+    /**
+     * Computes the grids of the nodes with the bin size (with lazy evaluation
+     * for printing num_of_result_bins bins). Lazy evaluation and the cost
+     * estimate need the supports of the nodes too.
+     */
+    void plan(int num_of_result_bins, real grid){
+        if(lazy || cost_limit != nullptr) tree.compute_supports(grid);
+        tree.plan_resolution(lazy ? num_of_result_bins : -1, grid);
+    }
+
+    /**
+     * Checks the estimated cost of the planned tree. Over the limit the
+     * expression is rejected, or with coarsening it is planned again with
+     * the bin size doubled until it fits (which is reported).
+     * Returns bool (the expression can be evaluated)
+     */
+    bool within_cost_limit(int num_of_result_bins){
+        real max_operations = cost_limit->max_operations;
+        real operations = Cost_estimate<real>::estimate(tree).operations;
+        if(max_operations <= 0 || operations <= max_operations) return true;
+
+        if(cost_limit->coarsen){
+            real grid = bin_size;
+            for(int i = 0; i < COST_MAX_COARSENING_STEPS; i++){
+                grid *= 2;
+                plan(num_of_result_bins, grid);
+                real coarse_operations = Cost_estimate<real>::estimate(tree).operations;
+                if(coarse_operations <= max_operations){
+                    std::cerr << "WARNING: MAX COST - EXPRESSION COMPUTED WITH BIN SIZE " << grid << " INSTEAD OF "
+                              << bin_size << " (ESTIMATED " << coarse_operations << " OPERATIONS, " << operations
+                              << " WITH BIN SIZE " << bin_size << ")." << std::endl;
+                    return true;
+                }
+            }
+        }
+        std::cerr << "ERROR: ESTIMATED COST " << operations << " OPERATIONS EXCEEDS THE LIMIT "
+                  << max_operations << ", EXPRESSION NOT COMPUTED." << std::endl;
+        return false;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,489 @@
+#ifndef EXPRESSION_TREE_HPP_
+#define EXPRESSION_TREE_HPP_
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <chrono>
+#include <charconv>
+#include <sys/stat.h>
+#include "operators.hpp"
+#include "snapshot.hpp"
+
+// how many computed bins should fall into one bin of the printed result
+#define LAZY_OVERSAMPLE 4
+
+template <typename real>
+class Token;
+
+template <typename real>
+class Leaf_cache;
+
+template <typename real>
+class Empirical_cache;
+
+/**
+ * One node of the expression tree. Leaves are numbers, inner nodes are
+ * binary operators (left and right are indices into the tree).
+ * Reference to a variable is a node with op 'v' and left pointing
+ * to the root of the bound subtree. Empirical distribution loaded from
+ * a file is a leaf with op '@' and number is the index of its path.
+ */
+template <typename real>
+struct Node{
+    char op; // operator, 0 for a number
+    real number;
+    int left;
+    int right;
+
+    // interval in which the values of the node lie (support of the distribution)
+    real lo;
+    real hi;
+    bool is_number; // the node evaluates to a number, not a distribution
+
+    // bin_size with which the node is computed
+    real grid;
+
+    // root of a subtree bound to a variable (its value is kept for references)
+    bool bound;
+
+    // zero inserted by the parser before a unary minus (not written in the input)
+    bool implicit;
+
+    Node(real number, bool implicit = false) : op(0), number(number), left(-1), right(-1),
+                                               lo(number), hi(number), is_number(true), grid(0), bound(false),
+                                               implicit(implicit) {}
+
+    Node(char op, int left, int right) : op(op), number(0), left(left), right(right),
+                                         lo(0), hi(0), is_number(false), grid(0), bound(false), implicit(false) {}
+
+    Interval<real> interval() const{
+        return {lo, hi, is_number};
+    }
+
+    /**
+     * Whether the value of the node can be in the snapshot store - results
+     * of the arithmetic operators (not leaves and leaf distributions).
+     */
+    bool is_storable() const{
+        return left >= 0 && right >= 0 && !is_leaf_distribution();
+    }
+
+    /**
+     * Whether the node creates a distribution from two numbers (i.e. '~').
+     */
+    bool is_leaf_distribution() const{
+        const Operator<real>* registered = Operator_registry<real>::find(op);
+        return registered != nullptr && registered->leaf != nullptr;
+    }
+};
+
+/**
+ * Expression stored as a tree instead of being evaluated right away.
+ * Nodes are stored in postfix order, so the children always precede
+ * their parent and the tree can be evaluated by a single pass.
+ *
+ * Lazy evaluation: before computing anything, we find out what resolution
+ * the printed result needs and propagate it from the root to the leaves.
+ * Every node is then computed with the coarsest bin_size (a multiple of
+ * the bin_size of the expression) that still gives LAZY_OVERSAMPLE computed
+ * bins per printed bin.
+ *
+ * Variables (let bindings) are subtrees that are not on the build stack.
+ * They are evaluated once and every reference gets a copy of the value,
+ * bindings that are never referenced are not evaluated at all.
+ */
+template <typename real>
+class Expression_tree{
+
+    std::vector<Node<real>> nodes;
+    std::vector<int> build_stack; // roots of subtrees that have no parent yet
+    std::map<std::string, int> symbols; // variable -> root of the bound subtree
+    std::vector<std::string> files; // paths of the empirical distributions
+
+public:
+
+    void clear(){
+        nodes.clear();
+        build_stack.clear();
+        symbols.clear();
+        files.clear();
+    }
+
+    size_t size() const{
+        return nodes.size();
+    }
+
+    Node<real>& operator[](size_t index){
+        return nodes[index];
+    }
+
+    const Node<real>& operator[](size_t index) const{
+        return nodes[index];
+    }
+
+    void add_number(real number, bool implicit = false){
+        build_stack.push_back(nodes.size());
+        nodes.emplace_back(number, implicit);
+    }
+
+    /**
+     * Adds an empirical distribution loaded from the file.
+     */
+    void add_file(const std::string& path){
+        build_stack.push_back(nodes.size());
+        nodes.emplace_back('@', -1, -1);
+        nodes.back().number = files.size();
+        files.push_back(path);
+    }
+
+    /**
+     * Returns the path of the file of the node with op '@'.
+     */
+    const std::string& file(const Node<real>& node) const{
+        return files[(size_t)node.number];
+    }
+
+    /**
+     * Adds a binary operator whose operands are the last two subtrees.
+     * Returns bool (success)
+     */
+    bool add_operator(char op){
+        if(build_stack.size() < 2) return false;
+
+        int right = build_stack.back();
+        build_stack.pop_back();
+        int left = build_stack.back();
+        build_stack.pop_back();
+
+        build_stack.push_back(nodes.size());
+        nodes.emplace_back(op, left, right);
+        return true;
+    }
+
+    /**
+     * Binds the last (and only) subtree to the variable.
+     * Returns bool (success)
+     */
+    bool bind(const std::string& name){
+        if(build_stack.size() != 1) return false;
+
+        int index = build_stack.back();
+        build_stack.pop_back();
+        nodes[index].bound = true;
+        symbols[name] = index;
+        return true;
+    }
+
+    /**
+     * Adds a reference to a bound variable.
+     * Returns bool (success), false for an unknown variable.
+     */
+    bool add_reference(const std::string& name){
+        auto symbol = symbols.find(name);
+        if(symbol == symbols.end()) return false;
+
+        build_stack.push_back(nodes.size());
+        nodes.emplace_back('v', symbol->second, -1);
+        return true;
+    }
+
+    /**
+     * Returns index of the root or -1 when the expression isn't complete.
+     */
+    int root() const{
+        if(build_stack.size() != 1) return -1;
+        return build_stack.back();
+    }
+
+    /**
+     * Computes the interval of values of each node (from the leaves to the root).
+     * The intervals copy the behaviour of the operators of Distribution.
+     * Empirical distributions are loaded with bin_size to get their range.
+     */
+    void compute_supports(real bin_size){
+        std::vector<char> needed = needed_nodes();
+        for(size_t i = 0; i < nodes.size(); i++){
+            Node<real>& node = nodes[i];
+            if(node.op == 0 || !needed[i]) continue;
+
+            if(node.op == '@'){
+                auto loaded = Empirical_cache<real>::instance().get(file(node), bin_size);
+                node.is_number = false;
+                node.lo = loaded->error_occurred ? 0 : loaded->get_from();
+                node.hi = loaded->error_occurred ? 0 : loaded->get_to();
+                continue;
+            }
+
+            if(node.op == 'v'){
+                Node<real>& bound = nodes[node.left];
+                node.is_number = bound.is_number;
+                node.number = bound.number;
+                node.lo = bound.lo;
+                node.hi = bound.hi;
+                continue;
+            }
+
+            Node<real>& a = nodes[node.left];
+            Node<real>& b = nodes[node.right];
+            const Operator<real>* op = Operator_registry<real>::find(node.op);
+            node.is_number = false;
+
+            // the same operation of numbers is computed now
+            if(op->leaf == nullptr && a.is_number && b.is_number){
+                node.is_number = true;
+                if(!op->number_number(a.number, b.number, node.number)) node.number = 0;
+                node.lo = node.hi = node.number;
+                continue;
+            }
+
+            Interval<real> support = op->support(a.interval(), b.interval());
+            node.lo = support.lo;
+            node.hi = support.hi;
+        }
+    }
+
+    /**
+     * Propagates the required resolution from the root to the leaves and
+     * saves it into Node::grid. num_of_result_bins is the number of printed
+     * bins (-1 means that every bin is printed and nothing can be coarsened).
+     */
+    void plan_resolution(int num_of_result_bins, real bin_size){
+        int index = root();
+        if(index < 0 || num_of_result_bins < 2){
+            for(auto&& node : nodes) node.grid = bin_size;
+            return;
+        }
+
+        // grid 0 means that no resolution is required yet
+        for(auto&& node : nodes) node.grid = 0;
+        Node<real>& root_node = nodes[index];
+        nodes[index].grid = (root_node.hi - root_node.lo) / (num_of_result_bins - 1) / LAZY_OVERSAMPLE;
+
+        // parents are stored after their children, so we go from the end
+        for(int i = (int)nodes.size() - 1; i >= 0; i--){
+            Node<real>& node = nodes[i];
+            real w = node.grid;
+            if(node.op == 0 || node.is_number) continue;
+
+            if(node.op == 'v'){ // the bound value has to be fine enough for every reference
+                Node<real>& bound = nodes[node.left];
+                bound.grid = bound.grid > 0 ? std::min(bound.grid, w) : w;
+                continue;
+            }
+
+            if(node.op == '@'){ // the same as a leaf distribution, the data are binned onto multiples of the grid
+                w = std::min(w, (node.hi - node.lo) / (num_of_result_bins - 1));
+                node.grid = file_grid(node.lo, node.hi, w, bin_size);
+                continue;
+            }
+
+            Node<real>& a = nodes[node.left];
+            Node<real>& b = nodes[node.right];
+
+            if(node.is_leaf_distribution()){
+                // the leaf has at least as many bins as the printed result
+                w = std::min(w, (node.hi - node.lo) / (num_of_result_bins - 1));
+                node.grid = leaf_grid(node.hi - node.lo, w, bin_size);
+                continue;
+            }
+            node.grid = snap_to_grid(w, bin_size);
+            Operator_registry<real>::find(node.op)->operand_grids(w, a.interval(), b.interval(), a.grid, b.grid);
+        }
+
+        for(auto&& node : nodes){
+            if(!node.is_leaf_distribution() && node.op != '@') node.grid = snap_to_grid(node.grid, bin_size);
+        }
+    }
+
+    /**
+     * Evaluates the tree (every node with its own grid) and returns the Token
+     * of the root. Stops at the first error.
+     * With the snapshot store, a node whose value is stored is loaded instead
+     * of computed (and its operands are not evaluated at all), computed
+     * distributions that took long are stored.
+     */
+    Token<real> evaluate(real std_deviation_quotient, Leaf_cache<real>* leaf_cache = nullptr,
+                         const Snapshot_store<real>* snapshots = nullptr){
+        std::vector<Token<real>> values(nodes.size());
+        std::vector<std::string> keys;
+        if(snapshots != nullptr) keys = snapshot_keys(*snapshots, std_deviation_quotient);
+
+        // stored values are loaded first, a file that can't be loaded is computed
+        std::vector<std::unique_ptr<Distribution<real>>> loaded(nodes.size());
+        std::vector<char> needed = needed_nodes([&](size_t index){
+            if(snapshots == nullptr || !nodes[index].is_storable() || !snapshots->contains(keys[index])) return false;
+            loaded[index] = snapshots->load(keys[index]);
+            return loaded[index] != nullptr;
+        });
+
+        for(size_t i = 0; i < nodes.size(); i++){
+            if(!needed[i]) continue;
+            Node<real>& node = nodes[i];
+
+            if(node.op == 0){
+                values[i] = Token<real>(node.number);
+            }
+            else if(node.op == 'v'){
+                values[i] = values[node.left].clone();
+            }
+            else if(node.op == '@'){
+                values[i] = Token<real>(Empirical_cache<real>::instance().get(file(node), node.grid));
+                if(values[i].error_occurred) return std::move(values[i]);
+            }
+            else{
+                if(loaded[i] != nullptr){
+                    values[i] = Token<real>(std::move(loaded[i]));
+                    continue;
+                }
+
+                Token<real> left(std::move(values[node.left]));
+                Token<real> right(std::move(values[node.right]));
+
+                // results are rounded to the grid of the node, not of the operands
+                left.set_bin_size(node.grid);
+                right.set_bin_size(node.grid);
+                auto start = std::chrono::steady_clock::now();
+                values[i] = Token<real>::operation(left, right, node.op, node.grid, std_deviation_quotient, leaf_cache);
+                if(values[i].error_occurred) return std::move(values[i]);
+
+                if(snapshots != nullptr && node.is_storable() && values[i].get_distribution() != nullptr &&
+                   std::chrono::steady_clock::now() - start >= std::chrono::microseconds(SNAPSHOT_MIN_MICROSECONDS)){
+                    snapshots->save(keys[i], *values[i].get_distribution());
+                }
+            }
+        }
+        return std::move(values[root()]);
+    }
+
+    /**
+     * Finds out which nodes have to be evaluated: the root and the operands
+     * of evaluated nodes, so bindings that are never referenced are skipped.
+     * Operands of the nodes for which stored(index) returns true (i.e. their
+     * values are loaded from the snapshot store) are skipped too.
+     */
+    template <typename Stored>
+    std::vector<char> needed_nodes(Stored&& stored) const{
+        std::vector<char> needed(nodes.size(), 0);
+        if(root() < 0) return needed;
+
+        needed[root()] = 1;
+        for(int i = (int)nodes.size() - 1; i >= 0; i--){
+            const Node<real>& node = nodes[i];
+            if(!needed[i] || node.left < 0) continue;
+            if(stored((size_t)i)) continue;
+
+            needed[node.left] = 1;
+            if(node.right >= 0) needed[node.right] = 1;
+        }
+        return needed;
+    }
+
+    std::vector<char> needed_nodes() const{
+        return needed_nodes([](size_t){ return false; });
+    }
+
+    /**
+     * Canonical text of the node (for the snapshot store) from the texts of
+     * its operands: postfix with every operator followed by its grid.
+     * Files are identified by the path, the modification time and the size.
+     */
+    std::string node_text(size_t index, const std::string& left, const std::string& right) const{
+        const Node<real>& node = nodes[index];
+        if(node.op == 0) return number_text(node.number);
+        if(node.op == 'v') return left;
+        if(node.op == '@'){
+            struct stat info;
+            if(stat(file(node).c_str(), &info) < 0) return "@" + file(node);
+            return "@" + file(node) + "#" + std::to_string(info.st_mtim.tv_sec) + "." +
+                   std::to_string(info.st_mtim.tv_nsec) + "#" + std::to_string(info.st_size) +
+                   "[" + number_text(node.grid) + "]";
+        }
+        return left + " " + right + " " + node.op + "[" + number_text(node.grid) + "]";
+    }
+
+    /**
+     * Shortest text of the number that is read back as the same number.
+     */
+    static std::string number_text(real number){
+        char text[64];
+        std::to_chars_result end = std::to_chars(text, text + sizeof(text), number);
+        return std::string(text, end.ptr - text);
+    }
+
+private:
+
+    /**
+     * Computes the keys of the storable nodes in the snapshot store
+     * (empty for the other nodes).
+     */
+    std::vector<std::string> snapshot_keys(const Snapshot_store<real>& snapshots, real std_deviation_quotient) const{
+        std::vector<std::string> texts(nodes.size());
+        std::vector<std::string> keys(nodes.size());
+        for(size_t i = 0; i < nodes.size(); i++){
+            const Node<real>& node = nodes[i];
+            texts[i] = node_text(i, node.left >= 0 ? texts[node.left] : std::string(),
+                                 node.right >= 0 ? texts[node.right] : std::string());
+            if(node.is_storable()) keys[i] = snapshots.key(texts[i], std_deviation_quotient);
+        }
+        return keys;
+    }
+
+    /**
+     * Coarsest multiple of bin_size that is not greater than w.
+     */
+    static real snap_to_grid(real w, real bin_size){
+        if(!(w > bin_size) || !std::isfinite(w)) return bin_size;
+        return std::floor(w / bin_size) * bin_size;
+    }
+
+    /**
+     * Grid of a leaf distribution of the given width. The grid is the coarsest
+     * multiple of bin_size not greater than w that divides the width, so that
+     * the leaf keeps its bounds.
+     */
+    static real leaf_grid(real width, real w, real bin_size){
+        real bins = std::round(width / bin_size);
+        if(bins < 1 || std::abs(bins * bin_size - width) > bin_size / DIVISION_ERROR) return snap_to_grid(w, bin_size);
+        return divisor_grid(bins, w, bin_size);
+    }
+
+    /**
+     * Grid of an empirical distribution with the support [lo, hi]. Values
+     * are binned onto multiples of the grid, so the grid is the coarsest
+     * multiple of bin_size not greater than w that divides both bounds
+     * (they are multiples of bin_size, the file is loaded with it).
+     */
+    static real file_grid(real lo, real hi, real w, real bin_size){
+        // too many bins to look for the divisors
+        if(!(std::max(std::abs(lo), std::abs(hi)) / bin_size < 1e12)) return snap_to_grid(w, bin_size);
+
+        long long a = std::llabs(std::llround(lo / bin_size));
+        long long b = std::llabs(std::llround(hi / bin_size));
+        while(b != 0){
+            long long rest = a % b;
+            a = b;
+            b = rest;
+        }
+        if(a < 1) return snap_to_grid(w, bin_size);
+        return divisor_grid(a, w, bin_size);
+    }
+
+    /**
+     * The greatest divisor d of num_of_bins with d * bin_size not greater
+     * than w, returns d * bin_size (at least bin_size).
+     */
+    static real divisor_grid(long long num_of_bins, real w, real bin_size){
+        long long best = 1;
+        for(long long d = 1; d * d <= num_of_bins; d++){
+            if(num_of_bins % d != 0) continue;
+            if(d * bin_size <= w) best = std::max(best, d);
+            if((num_of_bins / d) * bin_size <= w) best = std::max(best, num_of_bins / d);
+        }
+        return best * bin_size;
+    }
+};
+
+#endif
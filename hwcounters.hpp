@@ -0,0 +1,241 @@
+#ifndef HWCOUNTERS_HPP_
+#define HWCOUNTERS_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <iomanip>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/**
+ * Hardware performance counters of the operators (`--hwcounters`, Linux
+ * only): cycles, instructions, cache misses and branch misses are read by
+ * perf_event_open around every computed operator and leaf construction
+ * (Token::operation), summed per kind of the step (i.e. "dist * dist",
+ * "leaf ~") and printed with IPC and misses per bin at the end.
+ *
+ * Every thread opens its own group of counters (user space only) when it
+ * computes its first step. Counters the machine doesn't have (i.e. in a VM)
+ * are left out, when there is none, --hwcounters fails.
+ * When the counters are off, Token::operation only checks one flag.
+ */
+
+// cycles, instructions, cache misses, branch misses
+#define HWCOUNTERS_EVENTS 4
+
+/**
+ * Counts of the events (scaled when the kernel multiplexed the counters).
+ */
+struct Counter_values{
+    uint64_t counts[HWCOUNTERS_EVENTS] = {0, 0, 0, 0};
+
+    Counter_values& operator+=(const Counter_values& second){
+        for(int i = 0; i < HWCOUNTERS_EVENTS; i++) counts[i] += second.counts[i];
+        return *this;
+    }
+};
+
+/**
+ * Group of the counters of the calling thread.
+ */
+class Counter_group{
+
+    int fds[HWCOUNTERS_EVENTS] = {-1, -1, -1, -1};
+    int leader = -1;
+    int opened = 0;
+
+public:
+
+    // errno of the first counter that couldn't be opened
+    int error = 0;
+
+    Counter_group(){
+        static const uint64_t configs[HWCOUNTERS_EVENTS] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+
+        for(int i = 0; i < HWCOUNTERS_EVENTS; i++){
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = configs[i];
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                                     PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds[i] = syscall(SYS_perf_event_open, &attributes, 0, -1, leader, 0);
+            if(fds[i] < 0){
+                if(error == 0) error = errno;
+                continue;
+            }
+            if(leader < 0) leader = fds[i];
+            opened++;
+        }
+    }
+
+    ~Counter_group(){
+        for(int fd : fds){
+            if(fd >= 0) close(fd);
+        }
+    }
+
+    Counter_group(const Counter_group&) = delete;
+    Counter_group& operator=(const Counter_group&) = delete;
+
+    /**
+     * Whether at least one counter is open.
+     */
+    bool is_open() const{
+        return opened > 0;
+    }
+
+    /**
+     * Whether the counter of the event is open.
+     */
+    bool has(int event) const{
+        return fds[event] >= 0;
+    }
+
+    /**
+     * Reads all counters at once. Returns bool (success)
+     */
+    bool read_values(Counter_values& values) const{
+        if(leader < 0) return false;
+
+        // nr, time_enabled, time_running, {value, id} for every counter
+        uint64_t buffer[3 + 2 * HWCOUNTERS_EVENTS];
+        ssize_t size = read(leader, buffer, sizeof(buffer));
+        if(size < (ssize_t)(3 * sizeof(uint64_t))) return false;
+
+        double scale = buffer[2] > 0 ? (double)buffer[1] / buffer[2] : 1;
+        for(int i = 0, k = 0; i < HWCOUNTERS_EVENTS && k < (int)buffer[0]; i++){
+            if(fds[i] < 0) continue;
+            values.counts[i] = buffer[3 + 2 * k] * scale;
+            k++;
+        }
+        return true;
+    }
+
+    /**
+     * Group of the calling thread (opened by the first call).
+     */
+    static Counter_group& of_thread(){
+        thread_local Counter_group group;
+        return group;
+    }
+};
+
+/**
+ * Sums of the counters per kind of the step.
+ */
+class Hardware_counters{
+
+    struct Row{
+        size_t steps = 0;
+        size_t bins = 0;
+        Counter_values values;
+    };
+
+    std::map<std::string, Row> rows;
+    std::mutex mutex;
+    bool available[HWCOUNTERS_EVENTS] = {false, false, false, false};
+
+public:
+
+    static inline bool enabled = false;
+
+    static Hardware_counters& instance(){
+        static Hardware_counters counters;
+        return counters;
+    }
+
+    /**
+     * Opens the counters of the calling thread. Returns bool (success: at
+     * least one counter is available), otherwise error is set to the errno.
+     */
+    bool open(int& error){
+        Counter_group& group = Counter_group::of_thread();
+        error = group.error;
+        for(int i = 0; i < HWCOUNTERS_EVENTS; i++) available[i] = group.has(i);
+        return group.is_open();
+    }
+
+    /**
+     * Adds one step: its kind, bins of its result and the difference of the counters.
+     */
+    void record(const std::string& kind, size_t bins, const Counter_values& before, const Counter_values& after){
+        std::lock_guard<std::mutex> lock(mutex);
+        Row& row = rows[kind];
+        row.steps++;
+        row.bins += bins;
+        for(int i = 0; i < HWCOUNTERS_EVENTS; i++){
+            row.values.counts[i] += after.counts[i] >= before.counts[i] ? after.counts[i] - before.counts[i] : 0;
+        }
+    }
+
+    /**
+     * Prints the sums per kind of the step, IPC and misses per bin of the result.
+     */
+    void print(std::ostream& ostr){
+        std::lock_guard<std::mutex> lock(mutex);
+        ostr << "HWCOUNTERS: " << rows.size() << " KINDS OF STEPS" << '\n';
+        ostr << std::left << std::setw(18) << "step" << std::right << std::setw(8) << "count" << std::setw(12) << "bins"
+             << std::setw(15) << "cycles" << std::setw(15) << "instructions" << std::setw(7) << "IPC"
+             << std::setw(14) << "cache misses" << std::setw(11) << "per bin" << std::setw(15) << "branch misses"
+             << std::setw(11) << "per bin" << '\n';
+
+        Row total;
+        for(auto&& element : rows){
+            print_row(ostr, element.first, element.second);
+            total.steps += element.second.steps;
+            total.bins += element.second.bins;
+            total.values += element.second.values;
+        }
+        print_row(ostr, "total", total);
+        ostr << std::flush;
+    }
+
+private:
+
+    void print_row(std::ostream& ostr, const std::string& kind, const Row& row) const{
+        const uint64_t* counts = row.values.counts;
+        ostr << std::left << std::setw(18) << kind << std::right << std::setw(8) << row.steps << std::setw(12) << row.bins
+             << count(0, counts[0], 15) << count(1, counts[1], 15);
+        if(available[0] && available[1] && counts[0] > 0) ostr << std::setw(7) << std::fixed << std::setprecision(2)
+                                                               << (double)counts[1] / counts[0];
+        else ostr << std::setw(7) << "-";
+        ostr << count(2, counts[2], 14) << per_bin(2, counts[2], row.bins)
+             << count(3, counts[3], 15) << per_bin(3, counts[3], row.bins)
+             << std::defaultfloat << std::setprecision(6) << '\n';
+    }
+
+    /**
+     * Column of a count, "-" when the counter is not available.
+     */
+    std::string count(int event, uint64_t value, int width) const{
+        std::string text = available[event] ? std::to_string(value) : "-";
+        return std::string(text.size() < (size_t)width ? width - text.size() : 1, ' ') + text;
+    }
+
+    std::string per_bin(int event, uint64_t value, size_t bins) const{
+        std::string text = "-";
+        if(available[event] && bins > 0){
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.3f", (double)value / bins);
+            text = buffer;
+        }
+        return std::string(text.size() < 11 ? 11 - text.size() : 1, ' ') + text;
+    }
+};
+
+#endif
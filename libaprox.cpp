@@ -0,0 +1,146 @@
+#include <sstream>
+#include <mutex>
+
+#include "libaprox.hpp"
+#include "session.hpp"
+#include "parallel.hpp"
+#include "cache.hpp"
+
+using real = double;
+
+struct Compiled_expression::Implementation{
+    Session<real> session;
+
+    // the leaf cache used by the session (shared with the Evaluator)
+    std::shared_ptr<Leaf_cache<real>> leaf_cache;
+
+    Implementation(real bin_size, real std_deviation_quotient, const std::shared_ptr<Leaf_cache<real>>& leaf_cache) :
+        session(bin_size, std_deviation_quotient), leaf_cache(leaf_cache){
+        session.leaf_cache = leaf_cache.get();
+    }
+};
+
+bool Compiled_expression::is_compiled() const{
+    return implementation != nullptr;
+}
+
+size_t Compiled_expression::num_of_leaves() const{
+    return implementation == nullptr ? 0 : implementation->session.num_of_leaves();
+}
+
+bool Compiled_expression::leaf_value(size_t leaf, double& value) const{
+    if(leaf >= num_of_leaves()) return false;
+    value = implementation->session.leaf_value(leaf);
+    return true;
+}
+
+struct Evaluator::Implementation{
+    Evaluator_options options;
+    std::shared_ptr<Leaf_cache<real>> leaf_cache; // compiled expressions share it
+    Thread_pool pool;
+
+    // scratches of the pool threads (used only by one job at a time)
+    std::vector<Session_scratch<real>> pool_scratches;
+
+    // free scratches for evaluate() - every call takes one and returns it
+    std::vector<std::unique_ptr<Session_scratch<real>>> free_scratches;
+    std::mutex free_scratches_mutex;
+
+    Implementation(const Evaluator_options& options) : options(options),
+                                                        leaf_cache(std::make_shared<Leaf_cache<real>>(options.leaf_cache_size)),
+                                                        pool(number_of_threads(options.threads)),
+                                                        pool_scratches(pool.size()) {}
+
+    std::unique_ptr<Session_scratch<real>> take_scratch(){
+        std::lock_guard<std::mutex> lock(free_scratches_mutex);
+        if(free_scratches.empty()) return std::make_unique<Session_scratch<real>>();
+        std::unique_ptr<Session_scratch<real>> scratch = std::move(free_scratches.back());
+        free_scratches.pop_back();
+        return scratch;
+    }
+
+    void return_scratch(std::unique_ptr<Session_scratch<real>>&& scratch){
+        std::lock_guard<std::mutex> lock(free_scratches_mutex);
+        free_scratches.push_back(std::move(scratch));
+    }
+};
+
+/**
+ * Evaluates the session with the changed leaves into the result.
+ * Returns bool (success)
+ */
+static bool evaluate_session(const Session<real>& session, const std::vector<Leaf_value>& values,
+                             Session_scratch<real>& scratch, std::vector<Leaf_update<real>>& updates,
+                             Evaluation_result& result){
+    updates.clear();
+    for(auto&& value : values){
+        if(value.leaf >= session.num_of_leaves()) return false;
+        updates.push_back({value.leaf, value.value});
+    }
+
+    const Token<real>& token = session.evaluate_with(updates, scratch);
+    if(token.error_occurred) return false;
+
+    const Distribution<real>* distribution = token.get_distribution();
+    result.is_number = distribution == nullptr;
+    if(result.is_number){
+        result.number = token.get_number();
+        result.origin = result.number;
+        result.bin_size = 0;
+        result.bins.assign(1, 1);
+        return true;
+    }
+    result.number = 0;
+    result.origin = distribution->get_from();
+    result.bin_size = distribution->get_bin_size();
+    distribution->to_bins(result.bins);
+    return true;
+}
+
+Evaluator::Evaluator(const Evaluator_options& options) : implementation(std::make_unique<Implementation>(options)) {}
+
+Evaluator::~Evaluator() = default;
+
+bool Evaluator::compile(const std::string& text, bool postfix, Compiled_expression& compiled){
+    auto created = std::make_shared<Compiled_expression::Implementation>(implementation->options.bin_size,
+                                                                         implementation->options.std_deviation_quotient,
+                                                                         implementation->leaf_cache);
+
+    std::stringstream input(text);
+    if(!created->session.load(input, postfix)) return false;
+    compiled.implementation = std::move(created);
+    return true;
+}
+
+bool Evaluator::evaluate(const Compiled_expression& compiled, Evaluation_result& result){
+    return evaluate(compiled, std::vector<Leaf_value>(), result);
+}
+
+bool Evaluator::evaluate(const Compiled_expression& compiled, const std::vector<Leaf_value>& values,
+                         Evaluation_result& result){
+    if(!compiled.is_compiled()) return false;
+
+    std::unique_ptr<Session_scratch<real>> scratch = implementation->take_scratch();
+    std::vector<Leaf_update<real>> updates;
+    bool success = evaluate_session(compiled.implementation->session, values, *scratch, updates, result);
+    implementation->return_scratch(std::move(scratch));
+    return success;
+}
+
+bool Evaluator::evaluate_many(const Compiled_expression& compiled, const std::vector<std::vector<Leaf_value>>& points,
+                              std::vector<Evaluation_result>& results){
+    if(!compiled.is_compiled()) return false;
+    results.resize(points.size());
+
+    std::vector<char> succeeded(points.size(), 0);
+    std::vector<std::vector<Leaf_update<real>>> updates(implementation->pool.size());
+    implementation->pool.run(points.size(), [&](size_t index, unsigned int thread){
+        succeeded[index] = evaluate_session(compiled.implementation->session, points[index],
+                                            implementation->pool_scratches[thread], updates[thread], results[index]);
+    });
+
+    for(char success : succeeded){
+        if(!success) return false;
+    }
+    return true;
+}
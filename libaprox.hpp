@@ -0,0 +1,143 @@
+#ifndef LIBAPROX_HPP_
+#define LIBAPROX_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Interface of the library libaprox (libaprox.a, libaprox.so) for programs
+ * that evaluate expressions in-process. An expression is compiled once and
+ * then evaluated many times, possibly with different values of its numbers.
+ * The result is returned as an array of bins - no text is printed or parsed.
+ * In general returns false on failure and true on success.
+ *
+ *     Evaluator evaluator;
+ *     Compiled_expression expression;
+ *     Evaluation_result result;
+ *     if(evaluator.compile("0 ~ 100 + 0 ~ 10", false, expression) &&
+ *        evaluator.evaluate(expression, {{3, 20}}, result)){
+ *         // result.bins[i] is the probability of result.origin + i * result.bin_size
+ *     }
+ */
+
+struct Evaluator_options{
+    double bin_size = 1; // as the option -b
+    double std_deviation_quotient = 2;
+    int threads = 0; // threads of evaluate_many(), 0 = number of cores
+    size_t leaf_cache_size = 256; // how many leaf distributions are kept
+};
+
+/**
+ * New value of one number in the expression, numbers (leaves) are indexed
+ * from 0 in the order in which they appear in the expression (a unary minus
+ * adds no number, in `(-5) ~ 10` the number 5 is the leaf 0).
+ */
+struct Leaf_value{
+    size_t leaf;
+    double value;
+};
+
+/**
+ * Result of one evaluation. Reusing the same object for more evaluations
+ * reuses its memory.
+ */
+struct Evaluation_result{
+    bool is_number = false;
+    double number = 0; // value of a number result
+
+    // bins[i] is the probability of the value origin + i * bin_size
+    // (a number result has one bin and bin_size 0)
+    double origin = 0;
+    double bin_size = 0;
+    std::vector<double> bins;
+
+    const double* data() const{
+        return bins.data();
+    }
+
+    size_t size() const{
+        return bins.size();
+    }
+};
+
+/**
+ * Parsed expression with the values of its subexpressions. It is immutable
+ * after compilation, so more threads can evaluate it at once. Copies share
+ * the same compiled expression. It keeps the leaf cache of the Evaluator
+ * that compiled it alive, so it stays valid after the Evaluator is destroyed.
+ */
+class Compiled_expression{
+
+    friend class Evaluator;
+    struct Implementation;
+    std::shared_ptr<const Implementation> implementation;
+
+public:
+
+    bool is_compiled() const;
+    size_t num_of_leaves() const;
+
+    /**
+     * Saves the number of the leaf into value. Returns bool (success), false
+     * when the expression isn't compiled or the leaf doesn't exist.
+     */
+    bool leaf_value(size_t leaf, double& value) const;
+};
+
+/**
+ * Context of evaluations. It owns the thread pool, the cache of leaf
+ * distributions and the scratch buffers reused by evaluations (so that
+ * repeated evaluations don't allocate the vectors of the intermediate
+ * results again). All methods can be called from more threads at once.
+ *
+ * There is no arena for the bins themselves: bins of a distribution are
+ * nodes of a std::map allocated by the same (stateless) allocator in the
+ * whole program, and the cached leaves and the values kept by a compiled
+ * expression outlive any single evaluation, so an arena reset after an
+ * evaluation could not own them.
+ */
+class Evaluator{
+
+    struct Implementation;
+    std::unique_ptr<Implementation> implementation;
+
+public:
+
+    Evaluator(const Evaluator_options& options = Evaluator_options());
+    ~Evaluator();
+
+    Evaluator(const Evaluator&) = delete;
+    Evaluator& operator=(const Evaluator&) = delete;
+
+    /**
+     * Parses and evaluates the expression (infix or postfix, possibly
+     * with let bindings). Returns bool (success of the parsing)
+     */
+    bool compile(const std::string& text, bool postfix, Compiled_expression& compiled);
+
+    /**
+     * Returns the value of the compiled expression, false on an error
+     * of the evaluation (i.e. division by zero).
+     */
+    bool evaluate(const Compiled_expression& compiled, Evaluation_result& result);
+
+    /**
+     * Evaluates the expression with the given numbers changed, only the
+     * subexpressions depending on them are recomputed. Returns false on an
+     * error of the evaluation or when some leaf doesn't exist.
+     */
+    bool evaluate(const Compiled_expression& compiled, const std::vector<Leaf_value>& values,
+                  Evaluation_result& result);
+
+    /**
+     * Evaluates the expression for every point (set of changed numbers) on
+     * the thread pool, results[i] belongs to points[i]. Returns false when
+     * some of the evaluations failed.
+     */
+    bool evaluate_many(const Compiled_expression& compiled, const std::vector<std::vector<Leaf_value>>& points,
+                       std::vector<Evaluation_result>& results);
+};
+
+#endif
@@ -5,14 +5,36 @@
 #include <cmath>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <getopt.h>
+#include <cstring>
 #include <boost/math/distributions/normal.hpp>
 
 #include "distribution.hpp"
 #include "expression.hpp"
+#include "session.hpp"
+#include "sweep.hpp"
+#include "pipeline.hpp"
+#include "server.hpp"
+#include "result_format.hpp"
+#include "output_format.hpp"
+#include "spill.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "hwcounters.hpp"
 
 #define NUM_OF_RESULT_BINS_DEFAULT 25
 #define STANDARD_DEVIATION_QUOTIENT 2
 
+// formats of the results (--format)
+#define FORMAT_TEXT 0
+#define FORMAT_BIN 1
+#define FORMAT_CSV 2
+#define FORMAT_JSON 3
+
+// how many lines (and results) per worker thread can wait in the batch pipeline
+#define BATCH_BUFFER_PER_THREAD 64
+
 // real is the type that represents the real number
 template <typename real>
 struct Parsed_arguments{
@@ -23,6 +45,9 @@ struct Parsed_arguments{
 
     bool postfix;
 
+    // compute only with the resolution needed for the printed result
+    bool lazy;
+
     bool help_flag;
 
     bool output_flag;
@@ -31,20 +56,82 @@ struct Parsed_arguments{
     bool input_flag;
     char* input_file_name;
 
+    // leaves swept by --sweep (empty = no sweep)
+    std::vector<Sweep_parameter<real>> sweeps;
+
+    // number of threads, 0 = number of cores
+    int threads;
+
+    // every line of the input is a separate expression
+    bool batch;
+
+    // format of the results: FORMAT_TEXT, FORMAT_BIN (see result_format.hpp),
+    // FORMAT_CSV or FORMAT_JSON (see output_format.hpp)
+    int format;
+
+    // store of evaluated distributions (--snapshot DIR), nullptr = no store
+    std::shared_ptr<Snapshot_store<real>> snapshots;
+
+    // directory of the out-of-core distributions (--spill DIR), nullptr = in memory
+    char* spill_directory;
+
+    // print the computed operators sorted by time at the end (--stats)
+    bool stats;
+
+    // print the hardware performance counters of the operators at the end (--hwcounters)
+    bool hwcounters;
+
+    // print the estimated cost instead of evaluating the expression (--explain)
+    bool explain;
+
+    // expressions over the estimated cost are rejected or coarsened (--max-cost, --coarsen)
+    Cost_limit cost_limit;
+
+    // file of the timeline of the evaluation (--trace FILE), nullptr = no trace
+    char* trace_file;
+
+    // path of the Unix socket of the daemon (--serve), nullptr = no daemon
+    char* serve_path;
+
     bool error_occurred;
 
     Parsed_arguments(): bin_size(1),
                         num_of_result_bins(NUM_OF_RESULT_BINS_DEFAULT),
                         postfix(false),
+                        lazy(false),
                         help_flag(false),
                         output_flag(false),
                         input_flag(false),
+                        threads(0),
+                        batch(false),
+                        format(FORMAT_TEXT),
+                        spill_directory(nullptr),
+                        stats(false),
+                        hwcounters(false),
+                        explain(false),
+                        trace_file(nullptr),
+                        serve_path(nullptr),
                         error_occurred(false) {}
 
 };
 
+// codes of the long options that have no short option
+#define OPTION_SWEEP 256
+#define OPTION_BATCH 257
+#define OPTION_SERVE 258
+#define OPTION_FORMAT 259
+#define OPTION_SNAPSHOT 260
+#define OPTION_SPILL 261
+#define OPTION_STATS 262
+#define OPTION_TRACE 263
+#define OPTION_MEM_LIMIT 264
+#define OPTION_HWCOUNTERS 265
+#define OPTION_EXPLAIN 266
+#define OPTION_MAX_COST 267
+#define OPTION_COARSEN 268
+
 /**
- * Parses arguments using getopt and returns Parsed_arguments<real> with
+ * Parses arguments using getopt_long and returns Parsed_arguments<real> with
  * parsed arguments.
  */
 template <typename real>
@@ -54,9 +141,28 @@ Parsed_arguments<real> parse_arguments(int argc, char **argv){
     char* result_bins_char = nullptr;
     Parsed_arguments<real> args;
 
+    static struct option long_options[] = {
+        {"sweep", required_argument, nullptr, OPTION_SWEEP},
+        {"batch", no_argument, nullptr, OPTION_BATCH},
+        {"serve", required_argument, nullptr, OPTION_SERVE},
+        {"format", required_argument, nullptr, OPTION_FORMAT},
+        {"snapshot", required_argument, nullptr, OPTION_SNAPSHOT},
+        {"spill", required_argument, nullptr, OPTION_SPILL},
+        {"stats", no_argument, nullptr, OPTION_STATS},
+        {"trace", required_argument, nullptr, OPTION_TRACE},
+        {"mem-limit", required_argument, nullptr, OPTION_MEM_LIMIT},
+        {"hwcounters", no_argument, nullptr, OPTION_HWCOUNTERS},
+        {"explain", no_argument, nullptr, OPTION_EXPLAIN},
+        {"max-cost", required_argument, nullptr, OPTION_MAX_COST},
+        {"coarsen", no_argument, nullptr, OPTION_COARSEN},
+        {"threads", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
     // after argument : = it needs another argument
     // after argument :: = another argument is optional
-    while((c = getopt(argc, argv, "i:o:b:r:ph")) != -1){
+    while((c = getopt_long(argc, argv, "i:o:b:r:plj:h", long_options, nullptr)) != -1){
         bool s_in_switch = false;
         bool r_in_switch = false;
         switch (c){
@@ -75,6 +181,81 @@ Parsed_arguments<real> parse_arguments(int argc, char **argv){
             case 'p':
                 args.postfix = true;
                 break;
+            case 'l': // lazy evaluation
+                args.lazy = true;
+                break;
+            case OPTION_SWEEP: // sweep of a leaf: LEAF=FROM:TO:STEP
+                args.sweeps.emplace_back();
+                if(!args.sweeps.back().read(optarg)){
+                    std::cerr << "ERROR: UNABLE TO READ SWEEP " << optarg << " (FORMAT IS LEAF=FROM:TO:STEP)." << std::endl;
+                    args.error_occurred = true;
+                    return args;
+                }
+                break;
+            case OPTION_BATCH: // one expression per line
+                args.batch = true;
+                break;
+            case OPTION_SERVE: // daemon listening on a Unix socket
+                args.serve_path = optarg;
+                break;
+            case OPTION_FORMAT: // format of the results: text, bin, csv or json
+                if(std::string(optarg) == "text") args.format = FORMAT_TEXT;
+                else if(std::string(optarg) == "bin") args.format = FORMAT_BIN;
+                else if(std::string(optarg) == "csv") args.format = FORMAT_CSV;
+                else if(std::string(optarg) == "json") args.format = FORMAT_JSON;
+                else{
+                    std::cerr << "ERROR: UNKNOWN FORMAT " << optarg << " (USE text, bin, csv OR json)." << std::endl;
+                    args.error_occurred = true;
+                    return args;
+                }
+                break;
+            case OPTION_SNAPSHOT: // directory of the snapshot store
+                args.snapshots = std::make_shared<Snapshot_store<real>>(optarg);
+                if(!args.snapshots->open()){
+                    std::cerr << "ERROR: UNABLE TO CREATE THE SNAPSHOT DIRECTORY " << optarg << std::endl;
+                    args.error_occurred = true;
+                    return args;
+                }
+                break;
+            case OPTION_SPILL: // directory of the out-of-core distributions
+                args.spill_directory = optarg;
+                break;
+            case OPTION_STATS: // instrumentation of the operators
+                args.stats = true;
+                break;
+            case OPTION_HWCOUNTERS: // hardware performance counters of the operators
+                args.hwcounters = true;
+                break;
+            case OPTION_EXPLAIN: // estimated cost instead of the result
+                args.explain = true;
+                break;
+            case OPTION_MAX_COST: // admission control by the estimated cost
+                if(!(std::stringstream(optarg) >> args.cost_limit.max_operations) || args.cost_limit.max_operations <= 0){
+                    std::cerr << "ERROR: UNABLE TO READ THE MAXIMAL COST (NUMBER OF OPERATIONS, i.e. 1e9)." << std::endl;
+                    args.error_occurred = true;
+                    return args;
+                }
+                break;
+            case OPTION_COARSEN: // coarser bin size instead of rejecting the expression
+                args.cost_limit.coarsen = true;
+                break;
+            case OPTION_TRACE: // timeline in the Chrome trace-event format
+                args.trace_file = optarg;
+                break;
+            case OPTION_MEM_LIMIT: // memory budget of the distributions
+                if(!Memory_budget::read_limit(optarg, Memory_budget::limit)){
+                    std::cerr << "ERROR: UNABLE TO READ THE MEMORY LIMIT (USE i.e. 512M OR 2G)." << std::endl;
+                    args.error_occurred = true;
+                    return args;
+                }
+                break;
+            case 'j': // number of threads
+                if(!(std::stringstream(optarg) >> args.threads) || args.threads < 0){
+                    std::cerr << "ERROR: UNABLE TO READ NUMBER OF THREADS." << std::endl;
+                    args.error_occurred = true;
+                    return args;
+                }
+                break;
             case 'r': // how many bins to use during result presentation
                 result_bins_char = optarg;
                 r_in_switch = true;
@@ -165,14 +346,92 @@ bool print_help(Parsed_arguments<real>& args){
         std::cout << "    -p: read postfix notation, default: infix" << std::endl;
         std::cout << "    -b: bin_size - size of the bins in which the distributions are stored, default = 1" << std::endl;
         std::cout << "    -r: how many bins to use during result presentation, default = " << NUM_OF_RESULT_BINS_DEFAULT << std::endl;
+        std::cout << "    -l: lazy evaluation - compute only with the resolution needed for the result" << std::endl;
+        std::cout << "    --sweep LEAF=FROM:TO:STEP: evaluate the expression for every value of the LEAF-th number" << std::endl;
+        std::cout << "                               (numbers are counted from 0 as written, in (-5) ~ 10 the number 5" << std::endl;
+        std::cout << "                               is the 0-th and 10 is the 1st), can be used more times" << std::endl;
+        std::cout << "    -j, --threads: number of threads, default = number of cores" << std::endl;
+        std::cout << "    --batch: every line of the input is a separate expression, results are tagged" << std::endl;
+        std::cout << "             with line numbers (LINE n)" << std::endl;
+        std::cout << "    --format=FORMAT: format of the results, default = text (star bars), other formats" << std::endl;
+        std::cout << "                     are not supported with --sweep:" << std::endl;
+        std::cout << "                     bin - binary records with raw bins (see result_format.hpp)" << std::endl;
+        std::cout << "                     csv, json - bins, mean, variance and quantiles (see output_format.hpp)" << std::endl;
+        std::cout << "    --snapshot DIR: store distributions that took long to compute in DIR and load them" << std::endl;
+        std::cout << "                    instead of computing them again (i.e. after a restart)" << std::endl;
+        std::cout << "    --spill DIR: keep the distributions in files in DIR instead of the memory (for grids" << std::endl;
+        std::cout << "                 larger than the memory), only +, - and text results are supported" << std::endl;
+        std::cout << "    --stats: print every computed operator (operands, bins, time, bytes allocated for bins)" << std::endl;
+        std::cout << "             sorted by time and the totals to stderr at the end" << std::endl;
+        std::cout << "    --hwcounters: print cycles, instructions, IPC, cache and branch misses (also per bin)" << std::endl;
+        std::cout << "                  of every kind of operator and leaf to stderr at the end (Linux)" << std::endl;
+        std::cout << "    --trace FILE: write the timeline of the evaluation (parsing, operators, leaves," << std::endl;
+        std::cout << "                  normalization, output, threads) as Chrome trace-event JSON" << std::endl;
+        std::cout << "    --mem-limit BYTES: memory budget of the distributions (suffix K, M or G), results that" << std::endl;
+        std::cout << "                       wouldn't fit are computed with a coarser bin size (reported)" << std::endl;
+        std::cout << "    --explain: print the estimated bins, operations and memory of every node of the" << std::endl;
+        std::cout << "               expression and the totals instead of evaluating it" << std::endl;
+        std::cout << "    --max-cost OPS: reject expressions whose estimated number of operations (pairs of bins)" << std::endl;
+        std::cout << "                    is larger, with --coarsen they are computed with a coarser bin size" << std::endl;
+        std::cout << "    --serve PATH: run as a daemon answering requests on the Unix socket PATH" << std::endl;
+        std::cout << "                  (see aprox_client), stops on SIGINT or SIGTERM" << std::endl;
         std::cout << "Distributions: " << std::endl;
         std::cout << "    - '~' of 'n' for normal distribution" << std::endl;
         std::cout << "    - 'u' for uniform distribution" << std::endl;
+        std::cout << "    - '@path' for empirical distribution loaded from a file (samples or histogram)" << std::endl;
         return true;
     }
     return false;
 }
 
+/**
+ * Writes the result as one record of the binary format.
+ * Returns true on success, false on failure.
+ */
+template <typename real>
+bool output_binary(Parsed_arguments<real>& args, Expression<real>& expression){
+    const Token<real>* result = expression.result();
+    if(result == nullptr) return false;
+
+    std::vector<real> bins;
+    std::string record;
+    make_result_record(result, 0, bins, record);
+
+    std::ofstream out;
+    if(args.output_flag){
+        out.open(args.output_file_name, std::ios::binary);
+        if(!out.is_open()) return false;
+    }
+    std::ostream& ostr = args.output_flag ? out : std::cout;
+    ostr.write(record.data(), record.size());
+    ostr.flush();
+    return (bool)ostr;
+}
+
+/**
+ * Writes the result as CSV or JSON.
+ * Returns true on success, false on failure.
+ */
+template <typename real>
+bool output_table(Parsed_arguments<real>& args, Expression<real>& expression){
+    const Token<real>* result = expression.result();
+    if(result == nullptr) return false;
+
+    Result_writer<real> writer(args.format == FORMAT_JSON, args.num_of_result_bins);
+    writer.header();
+    writer.result(result, 0);
+
+    std::ofstream out;
+    if(args.output_flag){
+        out.open(args.output_file_name);
+        if(!out.is_open()) return false;
+    }
+    std::ostream& ostr = args.output_flag ? out : std::cout;
+    writer.write_to(ostr);
+    ostr.flush();
+    return (bool)ostr;
+}
+
 /**
  * Prints the result.
  * Returns true on success, false on failure.
@@ -181,6 +440,9 @@ template <typename real>
 bool output(Parsed_arguments<real>& args, Expression<real>& expression){
     bool success = true;
 
+    if(args.format == FORMAT_BIN) return output_binary(args, expression);
+    if(args.format == FORMAT_CSV || args.format == FORMAT_JSON) return output_table(args, expression);
+
     if(args.output_flag){
         std::ofstream out;
         out.open(args.output_file_name);
@@ -206,23 +468,268 @@ bool output(Parsed_arguments<real>& args, Expression<real>& expression){
  */
 template <typename real>
 bool compute(Parsed_arguments<real>& args, Expression<real>& expression, std::stringstream& input_buffer){
-    if(args.postfix){
-        if(!expression.parse_postfix_input(input_buffer)){
-            std::cerr << "ERROR: PROBLEM DURING EVALUATION OCCURED - PROBABLY WHAT HAPPENED:" << std::endl;
-            std::cerr << "     - DIVISION BY ZERO (BEWARE OF DISTRIBUTIONS WHICH INCLUDE ZERO)" << std::endl;
-            std::cerr << "     - WRONG INPUT (ERROR IN FORMAT - NOT ENOUGH OPERANDS, TOO MANY OPERANDS, NO MATCHING PARENTHESES,.." << std::endl;
-            return false;
+    if(!expression.parse_input(input_buffer, args.postfix) ||
+       !expression.evaluate(args.num_of_result_bins)){
+        std::cerr << "ERROR: PROBLEM DURING EVALUATION OCCURED - PROBABLY WHAT HAPPENED:" << std::endl;
+        std::cerr << "     - DIVISION BY ZERO (BEWARE OF DISTRIBUTIONS WHICH INCLUDE ZERO)" << std::endl;
+        std::cerr << "     - WRONG INPUT (ERROR IN FORMAT - NOT ENOUGH OPERANDS, TOO MANY OPERANDS, NO MATCHING PARENTHESES,.." << std::endl;
+        std::cerr << "     - UNKNOWN VARIABLE (VARIABLES ARE DEFINED BY `let name = expression;`)" << std::endl;
+        std::cerr << "     - FILE OF AN EMPIRICAL DISTRIBUTION (@path) CAN'T BE READ OR HAS NO VALUES" << std::endl;
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Prints the estimated cost of the expression instead of its result (--explain).
+ * Returns true on success, false when the expression can't be parsed.
+ */
+template <typename real>
+bool explain(Parsed_arguments<real>& args, Expression<real>& expression, std::stringstream& input_buffer){
+    if(!expression.parse_input(input_buffer, args.postfix) || !expression.explain(std::cout, args.num_of_result_bins)){
+        std::cerr << "ERROR: THE EXPRESSION CAN'T BE PARSED." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Evaluates the expression for every point of the sweep and prints
+ * the results.
+ * Returns true on success, false on failure.
+ */
+template <typename real>
+bool compute_sweep(Parsed_arguments<real>& args, std::stringstream& input_buffer){
+    Session<real> session(args.bin_size, STANDARD_DEVIATION_QUOTIENT);
+    session.snapshots = args.snapshots.get();
+    if(!session.load(input_buffer, args.postfix)){
+        std::cerr << "ERROR: WRONG INPUT (ERROR IN FORMAT - NOT ENOUGH OPERANDS, TOO MANY OPERANDS, NO MATCHING PARENTHESES,.." << std::endl;
+        return false;
+    }
+
+    std::ofstream out;
+    if(args.output_flag){
+        out.open(args.output_file_name);
+        if(!out.is_open()) return false;
+    }
+    std::ostream& ostr = args.output_flag ? out : std::cout;
+
+    if(!sweep(session, args.sweeps, number_of_threads(args.threads), ostr, args.num_of_result_bins)){
+        std::cerr << "ERROR: SWEPT LEAF DOESN'T EXIST (THE EXPRESSION HAS " << session.num_of_leaves() << " NUMBERS)." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Evaluates the expression out of core (see spill.hpp) and prints the result.
+ * Returns true on success, false on failure.
+ */
+template <typename real>
+bool compute_spilled(Parsed_arguments<real>& args, std::stringstream& input_buffer){
+    Spill_evaluator<real> evaluator(args.spill_directory, args.bin_size, STANDARD_DEVIATION_QUOTIENT);
+    if(!evaluator.open()){
+        std::cerr << "ERROR: UNABLE TO CREATE THE SPILL DIRECTORY " << args.spill_directory << std::endl;
+        return false;
+    }
+
+    Expression<real> parser(args.bin_size, STANDARD_DEVIATION_QUOTIENT, true);
+    Spilled_value<real> result;
+    if(!parser.parse_input(input_buffer, args.postfix) || !evaluator.evaluate(parser.get_tree(), result)){
+        std::cerr << "ERROR: PROBLEM DURING EVALUATION OCCURED (WRONG INPUT, UNSUPPORTED OPERATOR OR FILE)." << std::endl;
+        return false;
+    }
+
+    std::ofstream out;
+    if(args.output_flag){
+        out.open(args.output_file_name);
+        if(!out.is_open()) return false;
+    }
+    std::ostream& ostr = args.output_flag ? out : std::cout;
+    evaluator.print(result, ostr, args.num_of_result_bins);
+    ostr.flush();
+    return (bool)ostr;
+}
+
+/**
+ * Evaluates one line of the batch and writes its result preceded by `LINE n`
+ * (or tagged with the line number in the other formats, the writer is
+ * used for CSV and JSON).
+ */
+template <typename real>
+void evaluate_line(Parsed_arguments<real>& args, Expression<real>& expression, std::stringstream& line_buffer,
+                   const std::string& line, size_t line_number, std::ostream& ostr, Result_writer<real>& writer){
+    expression.reset();
+    line_buffer.clear();
+    line_buffer.str(line);
+
+    if(args.format != FORMAT_TEXT){
+        const Token<real>* result = nullptr;
+        if(expression.parse_input(line_buffer, args.postfix) && expression.evaluate(args.num_of_result_bins)){
+            result = expression.result();
         }
+        if(args.format == FORMAT_BIN){
+            std::vector<real> bins;
+            std::string record;
+            make_result_record(result, line_number, bins, record);
+            ostr.write(record.data(), record.size());
+            return;
+        }
+        writer.result(result, line_number);
+        writer.write_to(ostr);
+        return;
     }
-    else{
-        if(!expression.parse_infix_input(input_buffer)){
-            std::cerr << "ERROR: PROBLEM DURING EVALUATION OCCURED - PROBABLY WHAT HAPPENED:" << std::endl;
-            std::cerr << "     - DIVISION BY ZERO (BEWARE OF DISTRIBUTIONS WHICH INCLUDE ZERO)" << std::endl;
-            std::cerr << "     - WRONG INPUT (ERROR IN FORMAT - NOT ENOUGH OPERANDS, TOO MANY OPERANDS, NO MATCHING PARENTHESES,.." << std::endl;
+
+    ostr << "LINE " << line_number << '\n';
+    if(!expression.parse_input(line_buffer, args.postfix) ||
+       !expression.evaluate(args.num_of_result_bins) ||
+       !expression.print_result(ostr, args.num_of_result_bins)){
+        ostr << "ERROR" << '\n';
+    }
+}
+
+/**
+ * Whether the line contains only whitespace (such lines are skipped).
+ */
+bool is_blank(const std::string& line){
+    return line.find_first_not_of(" \t\r") == std::string::npos;
+}
+
+/**
+ * Batch evaluation on more threads. This thread reads the lines and hands
+ * them to the workers through a bounded queue, every worker has its own
+ * Expression. The writer thread puts the results back into the order of
+ * the input using a bounded reorder buffer. Both buffers block when they
+ * are full, so a slow writer can't make the memory grow.
+ */
+template <typename real>
+void compute_batch_parallel(Parsed_arguments<real>& args, std::istream& input, std::ostream& ostr,
+                            unsigned int threads){
+    struct Line{
+        size_t sequence; // order among the evaluated lines
+        size_t number; // line number in the input
+        std::string text;
+    };
+    Bounded_queue<Line> lines(BATCH_BUFFER_PER_THREAD * threads);
+    Reorder_buffer<std::string> results(BATCH_BUFFER_PER_THREAD * threads);
+
+    std::vector<std::thread> workers;
+    for(unsigned int i = 0; i < threads; i++){
+        workers.emplace_back([&]{
+            Trace::instance().name_thread("batch worker");
+            Expression<real> expression(args.bin_size, STANDARD_DEVIATION_QUOTIENT, args.lazy);
+            expression.snapshots = args.snapshots.get();
+            expression.cost_limit = args.cost_limit.max_operations > 0 ? &args.cost_limit : nullptr;
+            std::stringstream line_buffer;
+            std::stringstream output;
+            Result_writer<real> writer(args.format == FORMAT_JSON, args.num_of_result_bins);
+            Line line;
+            while(true){
+                {
+                    Trace_span wait("wait for line");
+                    if(!lines.pop(line)) break;
+                }
+                Trace_span span("line", line.number);
+                output.str("");
+                output.clear();
+                evaluate_line(args, expression, line_buffer, line.text, line.number, output, writer);
+                results.put(line.sequence, output.str());
+            }
+        });
+    }
+
+    std::thread writer([&]{
+        Trace::instance().name_thread("batch writer");
+        std::string result;
+        while(results.take(result)) ostr << result;
+    });
+
+    std::string text;
+    size_t number = 0;
+    size_t sequence = 0;
+    while(std::getline(input, text)){
+        number++;
+        if(is_blank(text)) continue;
+        lines.push({sequence++, number, std::move(text)});
+    }
+    lines.close();
+    results.finish(sequence);
+
+    for(auto&& worker : workers) worker.join();
+    writer.join();
+}
+
+/**
+ * Evaluates every line of the input as a separate expression. The input
+ * is streamed line by line and one Expression is reused per thread, so the
+ * memory doesn't grow with the size of the input. Every result is preceded
+ * by the line `LINE n`, failed lines print `ERROR`. Empty lines are skipped.
+ * With more threads the lines are evaluated in parallel (see
+ * compute_batch_parallel()), the results are still in the input order.
+ * Returns true on success, false when input or output can't be opened.
+ */
+template <typename real>
+bool compute_batch(Parsed_arguments<real>& args){
+    std::ifstream input_file;
+    if(args.input_flag){
+        input_file.open(args.input_file_name);
+        if(!input_file.is_open()){
+            std::cerr << "ERROR: UNABLE TO OPEN THE INPUT FILE " << args.input_file_name << std::endl;
             return false;
         }
     }
-    
+    std::istream& input = args.input_flag ? input_file : std::cin;
+
+    std::ofstream out;
+    if(args.output_flag){
+        out.open(args.output_file_name, std::ios::binary);
+        if(!out.is_open()) return false;
+    }
+    std::ostream& ostr = args.output_flag ? out : std::cout;
+
+    Result_writer<real> writer(args.format == FORMAT_JSON, args.num_of_result_bins);
+    if(args.format == FORMAT_CSV){
+        writer.header();
+        writer.write_to(ostr);
+    }
+
+    unsigned int threads = number_of_threads(args.threads);
+    if(threads > 1){
+        compute_batch_parallel(args, input, ostr, threads);
+        ostr.flush();
+        return true;
+    }
+
+    Expression<real> expression(args.bin_size, STANDARD_DEVIATION_QUOTIENT, args.lazy);
+    expression.snapshots = args.snapshots.get();
+    expression.cost_limit = args.cost_limit.max_operations > 0 ? &args.cost_limit : nullptr;
+    std::string line;
+    std::stringstream line_buffer;
+    size_t line_number = 0;
+
+    while(std::getline(input, line)){
+        line_number++;
+        if(is_blank(line)) continue;
+        Trace_span span("line", line_number);
+        evaluate_line(args, expression, line_buffer, line, line_number, ostr, writer);
+    }
+    ostr.flush();
+    return true;
+}
+
+/**
+ * Runs the daemon until it is stopped by a signal.
+ * Returns true on success, false when the socket can't be created.
+ */
+template <typename real>
+bool serve(Parsed_arguments<real>& args){
+    Server<real> server(STANDARD_DEVIATION_QUOTIENT);
+    server.cost_limit = args.cost_limit.max_operations > 0 ? &args.cost_limit : nullptr;
+    if(!server.serve(args.serve_path, number_of_threads(args.threads))){
+        std::cerr << "ERROR: UNABLE TO LISTEN ON THE SOCKET " << args.serve_path << std::endl;
+        return false;
+    }
     return true;
 }
 
@@ -232,12 +739,65 @@ int main(int argc, char **argv){
 
     Parsed_arguments<real> args = parse_arguments<real>(argc, argv);
 
-    Expression<real> expression(args.bin_size, STANDARD_DEVIATION_QUOTIENT);
+    Expression<real> expression(args.bin_size, STANDARD_DEVIATION_QUOTIENT, args.lazy);
+    expression.snapshots = args.snapshots.get();
+    if(args.explain || args.cost_limit.max_operations > 0) expression.cost_limit = &args.cost_limit;
     std::stringstream input_buffer;
     
     if(args.error_occurred) return 1;
     if(print_help<real>(args)) return 0;
+    if(args.stats){
+        // the stats are created before the handler is registered, so they are destroyed after it runs
+        Operation_stats::instance();
+        Operation_stats::enabled = true;
+        std::atexit([]{ Operation_stats::instance().print(std::cerr); });
+    }
+    if(args.hwcounters){
+        int error;
+        if(!Hardware_counters::instance().open(error)){
+            std::cerr << "ERROR: HARDWARE COUNTERS ARE NOT AVAILABLE (perf_event_open: " << std::strerror(error)
+                      << ", SEE /proc/sys/kernel/perf_event_paranoid)." << std::endl;
+            return 1;
+        }
+        Hardware_counters::enabled = true;
+        std::atexit([]{ Hardware_counters::instance().print(std::cerr); });
+    }
+    static const char* trace_file = args.trace_file;
+    if(trace_file != nullptr){
+        Trace::instance();
+        Trace::enabled = true;
+        Trace::instance().name_thread("main");
+        std::atexit([]{
+            if(!Trace::instance().write(trace_file)) std::cerr << "ERROR: UNABLE TO WRITE THE TRACE " << trace_file << std::endl;
+        });
+    }
+    if(args.spill_directory != nullptr && (args.batch || !args.sweeps.empty() || args.format != FORMAT_TEXT ||
+                                           args.serve_path != nullptr)){
+        std::cerr << "ERROR: --spill IS NOT SUPPORTED WITH --batch, --sweep, --serve AND --format." << std::endl;
+        return 1;
+    }
+    if(args.cost_limit.coarsen && args.cost_limit.max_operations <= 0){
+        std::cerr << "ERROR: --coarsen NEEDS --max-cost." << std::endl;
+        return 1;
+    }
+    if((args.explain || args.cost_limit.max_operations > 0) && (!args.sweeps.empty() || args.spill_directory != nullptr)){
+        std::cerr << "ERROR: --explain AND --max-cost ARE NOT SUPPORTED WITH --sweep AND --spill." << std::endl;
+        return 1;
+    }
+    if(args.explain && (args.batch || args.serve_path != nullptr || args.format != FORMAT_TEXT)){
+        std::cerr << "ERROR: --explain IS NOT SUPPORTED WITH --batch, --serve AND --format." << std::endl;
+        return 1;
+    }
+    if(args.serve_path != nullptr) return serve<real>(args) ? 0 : 1;
+    if(args.batch) return compute_batch<real>(args) ? 0 : 1;
     if(!read_input<real>(args, input_buffer)) return 1;
+    if(!args.sweeps.empty() && args.format != FORMAT_TEXT){
+        std::cerr << "ERROR: --format IS NOT SUPPORTED WITH --sweep." << std::endl;
+        return 1;
+    }
+    if(!args.sweeps.empty()) return compute_sweep<real>(args, input_buffer) ? 0 : 1;
+    if(args.spill_directory != nullptr) return compute_spilled<real>(args, input_buffer) ? 0 : 1;
+    if(args.explain) return explain<real>(args, expression, input_buffer) ? 0 : 1;
     if(!compute<real>(args, expression, input_buffer)) return 1;
     if(!output<real>(args, expression)) return 1;
 
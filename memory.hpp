@@ -0,0 +1,106 @@
+#ifndef MEMORY_HPP_
+#define MEMORY_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+
+/**
+ * Memory accounting of the distributions and the memory budget (`--mem-limit`).
+ *
+ * Bins of every Distribution are allocated by Counting_allocator, so
+ * live_bytes is the memory of all distributions that exist (counted only
+ * with a limit, to keep the shared atomic off the allocations otherwise) and
+ * allocated_bytes is the memory allocated by the thread (for `--stats`).
+ * With a limit, an operation whose result wouldn't fit into the budget is
+ * computed with a coarser bin_size instead (see Token::operation), and it
+ * is reported.
+ */
+
+// bytes of a node of std::map besides the stored pair (color and 3 pointers)
+#define MEMORY_NODE_OVERHEAD 32
+
+// results with fewer bins than this are not computed (the budget is exhausted)
+#define MEMORY_MIN_BINS 16
+
+class Memory_budget{
+public:
+
+    // bytes of the bins of all distributions (counted only with a limit)
+    static inline std::atomic<size_t> live_bytes{0};
+
+    // 0 = no limit, it is set before any distribution is created
+    static inline size_t limit = 0;
+
+    // bytes of the bins allocated by the calling thread (never decreases)
+    static inline thread_local size_t allocated_bytes = 0;
+
+    /**
+     * Bytes that can still be allocated (without a limit as many as possible).
+     */
+    static size_t available(){
+        if(limit == 0) return SIZE_MAX;
+        size_t live = live_bytes.load(std::memory_order_relaxed);
+        return live >= limit ? 0 : limit - live;
+    }
+
+    /**
+     * Reads the limit: bytes with an optional suffix K, M or G (powers of 1024).
+     * Returns bool (success)
+     */
+    static bool read_limit(const char* text, size_t& bytes){
+        std::stringstream tmp(text);
+        double value;
+        if(!(tmp >> value) || value <= 0) return false;
+
+        std::string suffix;
+        tmp >> suffix;
+        if(suffix == "K" || suffix == "k") value *= 1024.0;
+        else if(suffix == "M" || suffix == "m") value *= 1024.0 * 1024;
+        else if(suffix == "G" || suffix == "g") value *= 1024.0 * 1024 * 1024;
+        else if(!suffix.empty()) return false;
+
+        bytes = value;
+        return bytes > 0;
+    }
+};
+
+/**
+ * Allocator that counts the allocated bytes in Memory_budget::allocated_bytes
+ * and, with a limit, in Memory_budget::live_bytes.
+ */
+template <typename T>
+struct Counting_allocator{
+    using value_type = T;
+
+    Counting_allocator() = default;
+
+    template <typename U>
+    Counting_allocator(const Counting_allocator<U>&) {}
+
+    T* allocate(size_t count){
+        if(Memory_budget::limit > 0) Memory_budget::live_bytes.fetch_add(count * sizeof(T), std::memory_order_relaxed);
+        Memory_budget::allocated_bytes += count * sizeof(T);
+        return std::allocator<T>().allocate(count);
+    }
+
+    void deallocate(T* pointer, size_t count){
+        if(Memory_budget::limit > 0) Memory_budget::live_bytes.fetch_sub(count * sizeof(T), std::memory_order_relaxed);
+        std::allocator<T>().deallocate(pointer, count);
+    }
+
+    template <typename U>
+    bool operator==(const Counting_allocator<U>&) const{
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const Counting_allocator<U>&) const{
+        return false;
+    }
+};
+
+#endif
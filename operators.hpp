@@ -0,0 +1,183 @@
+#ifndef OPERATORS_HPP_
+#define OPERATORS_HPP_
+
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include "distribution.hpp"
+
+/**
+ * Interval in which the values of a (sub)expression lie.
+ */
+template <typename real>
+struct Interval{
+    real lo;
+    real hi;
+    bool is_number;
+};
+
+/**
+ * Description of one operator: its symbol, arity, priority and kernels.
+ *
+ * Distribution operators ('~', 'n', 'u') have only the leaf kernel, which
+ * creates a distribution from two numbers. Arithmetic operators have a kernel
+ * for each combination of operand types. Besides that every operator knows
+ * the interval of its result (support) and which bin sizes its operands need
+ * for the given bin size of the result (used by lazy evaluation).
+ */
+template <typename real>
+struct Operator{
+    char symbol;
+    int arity;
+    int priority;
+
+    Distribution<real> (*leaf)(real from, real to, real bin_size, real std_deviation_quotient);
+
+    // number op number, returns false on failure (division by zero)
+    bool (*number_number)(real left, real right, real& result);
+    Distribution<real> (*dist_number)(const Distribution<real>& left, real right);
+    Distribution<real> (*number_dist)(real left, const Distribution<real>& right);
+    Distribution<real> (*dist_dist)(const Distribution<real>& left, const Distribution<real>& right);
+
+    Interval<real> (*support)(const Interval<real>& left, const Interval<real>& right);
+    void (*operand_grids)(real grid, const Interval<real>& left, const Interval<real>& right,
+                          real& left_grid, real& right_grid);
+};
+
+/**
+ * Helpers for the interval arithmetic of the operators.
+ */
+template <typename real>
+struct Interval_helpers{
+
+    static Interval<real> product(real a_lo, real a_hi, real b_lo, real b_hi){
+        real products[] = {a_lo * b_lo, a_lo * b_hi, a_hi * b_lo, a_hi * b_hi};
+        return {*std::min_element(products, products + 4), *std::max_element(products, products + 4), false};
+    }
+
+    static real max_abs(const Interval<real>& interval){
+        return std::max(std::abs(interval.lo), std::abs(interval.hi));
+    }
+
+    static real min_abs(const Interval<real>& interval){
+        if(interval.lo <= 0 && interval.hi >= 0) return 0;
+        return std::min(std::abs(interval.lo), std::abs(interval.hi));
+    }
+};
+
+/**
+ * Table of all operators. To add an operator, add its row to the table.
+ * Lookup of an operator is a single index into a 256 entry array.
+ */
+template <typename real>
+struct Operator_registry{
+
+    using H = Interval_helpers<real>;
+
+    static constexpr Operator<real> table[] = {
+        {'+', 2, 1, nullptr,
+         [](real a, real b, real& result){ result = a + b; return true; },
+         [](const Distribution<real>& a, real b){ return a + b; },
+         [](real a, const Distribution<real>& b){ return a + b; },
+         [](const Distribution<real>& a, const Distribution<real>& b){ return a + b; },
+         [](const Interval<real>& a, const Interval<real>& b){
+             return Interval<real>{a.lo + b.lo, a.hi + b.hi, false};
+         },
+         [](real grid, const Interval<real>&, const Interval<real>&, real& a_grid, real& b_grid){
+             a_grid = grid;
+             b_grid = grid;
+         }},
+
+        {'-', 2, 1, nullptr,
+         [](real a, real b, real& result){ result = a - b; return true; },
+         [](const Distribution<real>& a, real b){ return a - b; },
+         [](real a, const Distribution<real>& b){ return a - b; },
+         [](const Distribution<real>& a, const Distribution<real>& b){ return a - b; },
+         [](const Interval<real>& a, const Interval<real>& b){
+             // scalar - distribution is computed as distribution - scalar
+             if(a.is_number) return Interval<real>{b.lo - a.lo, b.hi - a.lo, false};
+             return Interval<real>{a.lo - b.hi, a.hi - b.lo, false};
+         },
+         [](real grid, const Interval<real>&, const Interval<real>&, real& a_grid, real& b_grid){
+             a_grid = grid;
+             b_grid = grid;
+         }},
+
+        {'*', 2, 2, nullptr,
+         [](real a, real b, real& result){ result = a * b; return true; },
+         [](const Distribution<real>& a, real b){ return a * b; },
+         [](real a, const Distribution<real>& b){ return a * b; },
+         [](const Distribution<real>& a, const Distribution<real>& b){ return a * b; },
+         [](const Interval<real>& a, const Interval<real>& b){
+             return H::product(a.lo, a.hi, b.lo, b.hi);
+         },
+         [](real grid, const Interval<real>& a, const Interval<real>& b, real& a_grid, real& b_grid){
+             a_grid = H::max_abs(b) > 0 ? grid / H::max_abs(b) : grid;
+             b_grid = H::max_abs(a) > 0 ? grid / H::max_abs(a) : grid;
+         }},
+
+        {'/', 2, 2, nullptr,
+         [](real a, real b, real& result){
+             if(b == 0) return false;
+             result = a / b;
+             return true;
+         },
+         [](const Distribution<real>& a, real b){ return a / b; },
+         [](real a, const Distribution<real>& b){ return a / b; },
+         [](const Distribution<real>& a, const Distribution<real>& b){ return a / b; },
+         [](const Interval<real>& a, const Interval<real>& b){
+             if(b.lo <= 0 && b.hi >= 0) return Interval<real>{a.lo, a.hi, false}; // evaluation fails anyway
+             return H::product(a.lo, a.hi, 1 / b.hi, 1 / b.lo);
+         },
+         [](real grid, const Interval<real>& a, const Interval<real>& b, real& a_grid, real& b_grid){
+             real min_b = H::min_abs(b);
+             a_grid = grid * min_b;
+             b_grid = H::max_abs(a) > 0 ? grid * min_b * min_b / H::max_abs(a) : grid;
+         }},
+
+        {'~', 2, 3,
+         [](real from, real to, real bin_size, real std_deviation_quotient){
+             return Distribution<real>('~', from, to, bin_size, std_deviation_quotient);
+         },
+         nullptr, nullptr, nullptr, nullptr,
+         [](const Interval<real>& a, const Interval<real>& b){ return Interval<real>{a.lo, b.hi, false}; },
+         nullptr},
+
+        {'n', 2, 3,
+         [](real from, real to, real bin_size, real std_deviation_quotient){
+             return Distribution<real>('n', from, to, bin_size, std_deviation_quotient);
+         },
+         nullptr, nullptr, nullptr, nullptr,
+         [](const Interval<real>& a, const Interval<real>& b){ return Interval<real>{a.lo, b.hi, false}; },
+         nullptr},
+
+        {'u', 2, 3,
+         [](real from, real to, real bin_size, real std_deviation_quotient){
+             return Distribution<real>('u', from, to, bin_size, std_deviation_quotient);
+         },
+         nullptr, nullptr, nullptr, nullptr,
+         [](const Interval<real>& a, const Interval<real>& b){ return Interval<real>{a.lo, b.hi, false}; },
+         nullptr},
+    };
+
+    static constexpr int size = sizeof(table) / sizeof(table[0]);
+
+    static constexpr std::array<signed char, 256> make_index(){
+        std::array<signed char, 256> index{};
+        for(int i = 0; i < 256; i++) index[i] = -1;
+        for(int i = 0; i < size; i++) index[(unsigned char)table[i].symbol] = i;
+        return index;
+    }
+
+    static constexpr std::array<signed char, 256> index = make_index();
+
+    /**
+     * Returns the operator with the symbol or nullptr when there is none.
+     */
+    static const Operator<real>* find(char symbol){
+        signed char i = index[(unsigned char)symbol];
+        return i < 0 ? nullptr : &table[i];
+    }
+};
+
+#endif
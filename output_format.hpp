@@ -0,0 +1,244 @@
+#ifndef OUTPUT_FORMAT_HPP_
+#define OUTPUT_FORMAT_HPP_
+
+#include <charconv>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "expression.hpp"
+
+/**
+ * Machine readable output of the results (`--format=csv` and `--format=json`).
+ *
+ * The bins are summed into the number of bins given by `-r` (see
+ * Distribution::rebin()), the statistics are computed from all bins of
+ * the result.
+ *
+ * CSV has the columns `line,kind,lower,upper,value`, every result is
+ * a row per bin (kind `bin`, lower and upper edge of the bin and its
+ * probability) followed by rows `mean`, `variance` and `q<quantile>`
+ * (i.e. `q0.5`). Failed results are a single row with kind `error`.
+ *
+ * JSON is one object per line:
+ * {"line":1,"mean":..,"variance":..,"quantiles":{"0.5":..,..},
+ *  "lower":[..],"upper":[..],"probability":[..]}
+ * or {"line":1,"error":true}.
+ *
+ * Numbers are formatted by std::to_chars into a reused buffer, so
+ * formatting a result doesn't allocate and doesn't go through iostreams.
+ */
+
+// how much memory the buffer of the writer reserves at the beginning
+#define OUTPUT_BUFFER_RESERVE (1 << 16)
+
+// quantiles printed for every result
+static constexpr double OUTPUT_QUANTILES[] = {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99};
+
+/**
+ * Summary of a distribution stored in bins.
+ */
+template <typename real>
+struct Bin_statistics{
+    real mean;
+    real variance;
+    real quantiles[sizeof(OUTPUT_QUANTILES) / sizeof(OUTPUT_QUANTILES[0])];
+
+    /**
+     * Computes the statistics, bins[i] is the probability of the value
+     * origin + i * bin_size. Quantiles are interpolated linearly inside
+     * the bins.
+     */
+    void compute(const std::vector<real>& bins, real origin, real bin_size){
+        real sum = 0;
+        real weighted = 0;
+        for(size_t i = 0; i < bins.size(); i++){
+            sum += bins[i];
+            weighted += bins[i] * (origin + i * bin_size);
+        }
+        if(sum <= 0) sum = 1;
+        mean = weighted / sum;
+
+        variance = 0;
+        for(size_t i = 0; i < bins.size(); i++){
+            real difference = origin + i * bin_size - mean;
+            variance += bins[i] * difference * difference;
+        }
+        variance /= sum;
+
+        // one pass over the bins for all quantiles (they are sorted)
+        size_t bin = 0;
+        real cumulative = 0;
+        for(size_t q = 0; q < sizeof(OUTPUT_QUANTILES) / sizeof(OUTPUT_QUANTILES[0]); q++){
+            real target = OUTPUT_QUANTILES[q] * sum;
+            while(bin + 1 < bins.size() && cumulative + bins[bin] < target){
+                cumulative += bins[bin];
+                bin++;
+            }
+            real inside = bins[bin] > 0 ? (target - cumulative) / bins[bin] : 0.5;
+            inside = std::max<real>(0, std::min<real>(1, inside));
+            quantiles[q] = origin + (bin - 0.5 + inside) * bin_size;
+        }
+    }
+};
+
+/**
+ * Formats results as CSV or JSON into its buffer. One writer is used by
+ * one thread, the buffer is written by write_to() in one call.
+ */
+template <typename real>
+class Result_writer{
+
+    std::string buffer;
+    std::vector<real> bins;
+    std::vector<char> filled;
+    Bin_statistics<real> statistics;
+    bool json;
+    int num_of_result_bins;
+
+public:
+
+    Result_writer(bool json, int num_of_result_bins) : json(json), num_of_result_bins(num_of_result_bins){
+        buffer.reserve(OUTPUT_BUFFER_RESERVE);
+    }
+
+    /**
+     * Appends the header of the CSV (nothing for JSON).
+     */
+    void header(){
+        if(!json) buffer += "line,kind,lower,upper,value\n";
+    }
+
+    /**
+     * Appends the result (nullptr = failed result).
+     */
+    void result(const Token<real>* result, size_t line){
+        Trace_span span(json ? "format json" : "format csv");
+        if(result == nullptr || result->error_occurred){
+            if(json){
+                buffer += "{\"line\":";
+                append(line);
+                buffer += ",\"error\":true}\n";
+            }
+            else{
+                append(line);
+                buffer += ",error,,,\n";
+            }
+            return;
+        }
+
+        real origin, bin_size;
+        const Distribution<real>* distribution = result->get_distribution();
+        if(distribution != nullptr){
+            origin = distribution->get_from();
+            distribution->to_bins(bins);
+            statistics.compute(bins, origin, distribution->get_bin_size());
+            bin_size = distribution->rebin(num_of_result_bins, bins, filled);
+        }
+        else{
+            origin = result->get_number();
+            bin_size = 0;
+            bins.assign(1, 1);
+            statistics.compute(bins, origin, bin_size);
+        }
+
+        if(json) append_json(line, origin, bin_size);
+        else append_csv(line, origin, bin_size);
+    }
+
+    /**
+     * Writes the buffer into the stream and empties it.
+     */
+    void write_to(std::ostream& ostr){
+        ostr.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    const std::string& get_buffer() const{
+        return buffer;
+    }
+
+    void clear(){
+        buffer.clear();
+    }
+
+private:
+
+    void append(real value){
+        char number[64];
+        std::to_chars_result end = std::to_chars(number, number + sizeof(number), value);
+        buffer.append(number, end.ptr - number);
+    }
+
+    void append(size_t value){
+        char number[32];
+        std::to_chars_result end = std::to_chars(number, number + sizeof(number), value);
+        buffer.append(number, end.ptr - number);
+    }
+
+    void append_csv(size_t line, real origin, real bin_size){
+        for(size_t i = 0; i < bins.size(); i++){
+            append(line);
+            buffer += ",bin,";
+            append(origin + (i - (real)0.5) * bin_size);
+            buffer += ',';
+            append(origin + (i + (real)0.5) * bin_size);
+            buffer += ',';
+            append(bins[i]);
+            buffer += '\n';
+        }
+
+        append(line);
+        buffer += ",mean,,,";
+        append(statistics.mean);
+        buffer += '\n';
+        append(line);
+        buffer += ",variance,,,";
+        append(statistics.variance);
+        buffer += '\n';
+        for(size_t q = 0; q < sizeof(OUTPUT_QUANTILES) / sizeof(OUTPUT_QUANTILES[0]); q++){
+            append(line);
+            buffer += ",q";
+            append((real)OUTPUT_QUANTILES[q]);
+            buffer += ",,,";
+            append(statistics.quantiles[q]);
+            buffer += '\n';
+        }
+    }
+
+    void append_json(size_t line, real origin, real bin_size){
+        buffer += "{\"line\":";
+        append(line);
+        buffer += ",\"mean\":";
+        append(statistics.mean);
+        buffer += ",\"variance\":";
+        append(statistics.variance);
+
+        buffer += ",\"quantiles\":{";
+        for(size_t q = 0; q < sizeof(OUTPUT_QUANTILES) / sizeof(OUTPUT_QUANTILES[0]); q++){
+            if(q > 0) buffer += ',';
+            buffer += '"';
+            append((real)OUTPUT_QUANTILES[q]);
+            buffer += "\":";
+            append(statistics.quantiles[q]);
+        }
+
+        buffer += "},\"lower\":[";
+        for(size_t i = 0; i < bins.size(); i++){
+            if(i > 0) buffer += ',';
+            append(origin + (i - (real)0.5) * bin_size);
+        }
+        buffer += "],\"upper\":[";
+        for(size_t i = 0; i < bins.size(); i++){
+            if(i > 0) buffer += ',';
+            append(origin + (i + (real)0.5) * bin_size);
+        }
+        buffer += "],\"probability\":[";
+        for(size_t i = 0; i < bins.size(); i++){
+            if(i > 0) buffer += ',';
+            append(bins[i]);
+        }
+        buffer += "]}\n";
+    }
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include "trace.hpp"
+
+/**
+ * Returns the number of threads to use: requested if it is positive,
+ * otherwise the number of cores.
+ */
+inline unsigned int number_of_threads(int requested){
+    if(requested > 0) return requested;
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores == 0 ? 1 : cores;
+}
+
+/**
+ * Calls function(index, thread) for every index from 0 to count - 1.
+ * Indices are handed out one by one to the threads (thread is the number
+ * of the thread from 0 to threads - 1, i.e. for thread-local buffers).
+ */
+template <typename Function>
+void parallel_for(size_t count, unsigned int threads, Function function){
+    threads = std::max(1u, std::min<unsigned int>(threads, count));
+    std::atomic<size_t> next(0);
+
+    auto worker = [&](unsigned int thread){
+        for(size_t index = next++; index < count; index = next++){
+            function(index, thread);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned int thread = 1; thread < threads; thread++){
+        workers.emplace_back([&worker, thread]{
+            Trace::instance().name_thread("parallel worker");
+            worker(thread);
+        });
+    }
+    worker(0);
+    for(auto&& thread : workers) thread.join();
+}
+
+/**
+ * Threads that are created once and then run one parallel_for-like job
+ * after another, so a job doesn't pay for starting the threads. The thread
+ * calling run() works as the thread 0.
+ */
+class Thread_pool{
+
+    std::vector<std::thread> workers;
+    std::function<void(size_t, unsigned int)> task;
+    size_t count;
+    std::atomic<size_t> next;
+    unsigned int busy; // workers that haven't finished the current job
+    unsigned long job; // number of the current job
+    bool stopping;
+
+    std::mutex mutex;
+    std::mutex run_mutex; // one job at a time
+    std::condition_variable started;
+    std::condition_variable finished;
+
+public:
+
+    Thread_pool(unsigned int threads) : count(0), next(0), busy(0), job(0), stopping(false){
+        for(unsigned int thread = 1; thread < std::max(1u, threads); thread++){
+            workers.emplace_back([this, thread]{ wait_for_jobs(thread); });
+        }
+    }
+
+    ~Thread_pool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            started.notify_all();
+        }
+        for(auto&& worker : workers) worker.join();
+    }
+
+    /**
+     * Number of threads including the calling one.
+     */
+    unsigned int size() const{
+        return workers.size() + 1;
+    }
+
+    /**
+     * Calls function(index, thread) for every index from 0 to count - 1
+     * (see parallel_for()) and waits until all calls finish.
+     */
+    void run(size_t count, std::function<void(size_t, unsigned int)> function){
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = std::move(function);
+            this->count = count;
+            next = 0;
+            busy = workers.size();
+            job++;
+            started.notify_all();
+        }
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&]{ return busy == 0; });
+        task = nullptr;
+    }
+
+private:
+
+    void work(unsigned int thread){
+        for(size_t index = next++; index < count; index = next++){
+            task(index, thread);
+        }
+    }
+
+    void wait_for_jobs(unsigned int thread){
+        unsigned long done = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true){
+            started.wait(lock, [&]{ return stopping || job != done; });
+            if(stopping) return;
+            done = job;
+
+            lock.unlock();
+            work(thread);
+            lock.lock();
+            if(--busy == 0) finished.notify_one();
+        }
+    }
+};
+
+#endif
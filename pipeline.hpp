@@ -0,0 +1,124 @@
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Queue with bounded capacity shared by threads. push() blocks while
+ * the queue is full (backpressure), pop() blocks while it is empty.
+ */
+template <typename T>
+class Bounded_queue{
+
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+
+public:
+
+    Bounded_queue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    /**
+     * Returns false if the queue was closed (the item is not added).
+     */
+    bool push(T&& item){
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&]{ return items.size() < capacity || closed; });
+        if(closed) return false;
+
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Returns false when the queue is closed and empty.
+     */
+    bool pop(T& item){
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&]{ return !items.empty() || closed; });
+        if(items.empty()) return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * No more items will be pushed, waiting threads are woken up.
+     */
+    void close(){
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+};
+
+/**
+ * Returns results to the order of their sequence numbers (0, 1, 2, ...).
+ * Only results with sequence numbers smaller than next + capacity are
+ * accepted (next is the sequence number the writer waits for), so put()
+ * blocks when the writer is slow and the memory stays bounded.
+ */
+template <typename T>
+class Reorder_buffer{
+
+    std::vector<T> slots;
+    std::vector<bool> filled;
+    size_t next; // sequence number of the next result to take
+    size_t total; // number of results, known when the input ends
+
+    std::mutex mutex;
+    std::condition_variable slot_free;
+    std::condition_variable next_ready;
+
+public:
+
+    Reorder_buffer(size_t capacity) : slots(capacity), filled(capacity, false),
+                                      next(0), total((size_t)-1) {}
+
+    void put(size_t sequence, T&& item){
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_free.wait(lock, [&]{ return sequence < next + slots.size(); });
+
+        slots[sequence % slots.size()] = std::move(item);
+        filled[sequence % slots.size()] = true;
+        if(sequence == next) next_ready.notify_one();
+    }
+
+    /**
+     * Takes the next result in order.
+     * Returns false when all results were taken.
+     */
+    bool take(T& item){
+        std::unique_lock<std::mutex> lock(mutex);
+        next_ready.wait(lock, [&]{ return filled[next % slots.size()] || next == total; });
+        if(next == total) return false;
+
+        item = std::move(slots[next % slots.size()]);
+        filled[next % slots.size()] = false;
+        next++;
+        slot_free.notify_all();
+        return true;
+    }
+
+    /**
+     * Sets the number of results (called when the input ends).
+     */
+    void finish(size_t number_of_results){
+        std::lock_guard<std::mutex> lock(mutex);
+        total = number_of_results;
+        next_ready.notify_all();
+    }
+};
+
+#endif
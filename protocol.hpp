@@ -0,0 +1,134 @@
+#ifndef PROTOCOL_HPP_
+#define PROTOCOL_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+
+/**
+ * Protocol of `aprox --serve` (local Unix socket, native byte order).
+ *
+ * Request:  Request_header followed by `length` bytes of the expression
+ *           (the expression may start with let bindings).
+ * Response: Response_header followed by `length` bytes of the result -
+ *           the printed result or a binary result (PROTOCOL_BINARY):
+ *           Binary_result_header followed by `count` doubles (bins).
+ * More requests can be sent over one connection.
+ */
+
+// flags of the request
+#define PROTOCOL_POSTFIX 1
+#define PROTOCOL_LAZY 2
+#define PROTOCOL_BINARY 4
+
+// maximal length of an expression in bytes
+#define PROTOCOL_MAX_REQUEST (1 << 20)
+
+// status of the response
+#define PROTOCOL_OK 0
+#define PROTOCOL_ERROR 1
+
+struct Request_header{
+    uint32_t length; // length of the expression
+    uint32_t flags;
+    int32_t num_of_result_bins; // as the option -r
+    uint32_t reserved;
+    double bin_size; // as the option -b
+};
+
+struct Response_header{
+    uint32_t status;
+    uint32_t length; // length of the result
+};
+
+struct Binary_result_header{
+    double origin; // value of the first bin
+    double bin_size; // 0 for a number
+    uint64_t count; // number of bins
+};
+
+/**
+ * Reads exactly size bytes. Returns false on error or end of the stream.
+ */
+inline bool read_all(int fd, void* buffer, size_t size){
+    char* position = (char*)buffer;
+    while(size > 0){
+        ssize_t count = read(fd, position, size);
+        if(count < 0 && errno == EINTR) continue;
+        if(count <= 0) return false;
+        position += count;
+        size -= count;
+    }
+    return true;
+}
+
+/**
+ * Writes exactly size bytes. Returns false on error.
+ */
+inline bool write_all(int fd, const void* buffer, size_t size){
+    const char* position = (const char*)buffer;
+    while(size > 0){
+        ssize_t count = write(fd, position, size);
+        if(count < 0 && errno == EINTR) continue;
+        if(count <= 0) return false;
+        position += count;
+        size -= count;
+    }
+    return true;
+}
+
+/**
+ * Fills the address of the Unix socket. Returns false when the path is too long.
+ */
+inline bool socket_address(const char* path, sockaddr_un& address){
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)) return false;
+    strcpy(address.sun_path, path);
+    return true;
+}
+
+/**
+ * Connects to the server. Returns the socket or -1 on failure.
+ */
+inline int connect_socket(const char* path){
+    sockaddr_un address;
+    if(!socket_address(path, address)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    if(connect(fd, (sockaddr*)&address, sizeof(address)) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Sends the request with one write. Returns bool (success)
+ */
+inline bool send_request(int fd, const std::string& expression, uint32_t flags,
+                         int num_of_result_bins, double bin_size){
+    Request_header header = {(uint32_t)expression.size(), flags, num_of_result_bins, 0, bin_size};
+    std::string message((const char*)&header, sizeof(header));
+    message += expression;
+    return write_all(fd, message.data(), message.size());
+}
+
+/**
+ * Reads a response. Returns bool (success of the communication)
+ */
+inline bool read_response(int fd, uint32_t& status, std::string& result){
+    Response_header header;
+    if(!read_all(fd, &header, sizeof(header))) return false;
+
+    status = header.status;
+    result.resize(header.length);
+    return read_all(fd, &result[0], header.length);
+}
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef RESULT_FORMAT_HPP_
+#define RESULT_FORMAT_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "distribution.hpp"
+#include "trace.hpp"
+
+template <typename real>
+class Token;
+
+/**
+ * Binary format of the results (`--format=bin`). The output is a sequence
+ * of records, one per result (one per line in the batch mode):
+ * Result_record_header followed by `count` bins of the type `real_type`,
+ * padded to RESULT_RECORD_ALIGNMENT bytes. bins[i] is the probability of
+ * the value origin + i * bin_size, a number is stored as one bin with
+ * bin_size 0. Failed results have status RESULT_ERROR and no bins.
+ * Native byte order, the records can be read in place from an mmap-ed
+ * file (see Result_file).
+ */
+
+#define RESULT_MAGIC 0x58525041 // "APRX"
+#define RESULT_RECORD_ALIGNMENT 16
+
+// status of the record
+#define RESULT_OK 0
+#define RESULT_ERROR 1
+
+// type of the bins
+#define RESULT_REAL_FLOAT 1
+#define RESULT_REAL_DOUBLE 2
+#define RESULT_REAL_LONG_DOUBLE 3
+
+struct Result_record_header{
+    uint32_t magic;
+    uint16_t status;
+    uint16_t real_type;
+    uint64_t line; // line of the input (batch mode), otherwise 0
+    double origin;
+    double bin_size;
+    uint64_t count; // number of bins
+    uint64_t size; // size of the whole record including the header and padding
+};
+
+/**
+ * Returns the size of one bin of the RESULT_REAL_* type, 0 for an unknown type.
+ */
+inline size_t result_real_size(uint16_t real_type){
+    switch(real_type){
+        case RESULT_REAL_FLOAT: return sizeof(float);
+        case RESULT_REAL_DOUBLE: return sizeof(double);
+        case RESULT_REAL_LONG_DOUBLE: return sizeof(long double);
+        default: return 0;
+    }
+}
+
+/**
+ * Whether the record at the beginning of available bytes is valid: it has
+ * the magic, a known type of the bins, fits into the available bytes and
+ * its bins fit into the record (a truncated or corrupt file).
+ */
+inline bool valid_result_record(const Result_record_header* header, size_t available){
+    if(available < sizeof(Result_record_header) || header->magic != RESULT_MAGIC) return false;
+    if(header->size < sizeof(Result_record_header) || header->size > available) return false;
+
+    size_t real_size = result_real_size(header->real_type);
+    return real_size > 0 && header->count <= (header->size - sizeof(Result_record_header)) / real_size;
+}
+
+/**
+ * Returns the RESULT_REAL_* code of the type real.
+ */
+template <typename real>
+constexpr uint16_t result_real_type(){
+    if(std::is_same<real, float>::value) return RESULT_REAL_FLOAT;
+    if(std::is_same<real, double>::value) return RESULT_REAL_DOUBLE;
+    return RESULT_REAL_LONG_DOUBLE;
+}
+
+/**
+ * Stores the result (nullptr = failed result) as one record into the
+ * record buffer (its previous content is replaced), so that it can be
+ * written by one write call. bins is a reused buffer.
+ */
+template <typename real>
+void make_result_record(const Token<real>* result, uint64_t line, std::vector<real>& bins, std::string& record){
+    Trace_span span("format bin");
+    Result_record_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RESULT_MAGIC;
+    header.status = RESULT_OK;
+    header.real_type = result_real_type<real>();
+    header.line = line;
+
+    bins.clear();
+    if(result == nullptr || result->error_occurred) header.status = RESULT_ERROR;
+    else if(result->get_distribution() != nullptr){
+        header.origin = result->get_distribution()->get_from();
+        header.bin_size = result->get_distribution()->get_bin_size();
+        result->get_distribution()->to_bins(bins);
+    }
+    else{
+        header.origin = result->get_number();
+        bins.assign(1, 1);
+    }
+    header.count = bins.size();
+
+    size_t size = sizeof(header) + bins.size() * sizeof(real);
+    header.size = (size + RESULT_RECORD_ALIGNMENT - 1) / RESULT_RECORD_ALIGNMENT * RESULT_RECORD_ALIGNMENT;
+
+    record.assign(header.size, '\0');
+    memcpy(&record[0], &header, sizeof(header));
+    if(!bins.empty()) memcpy(&record[sizeof(header)], bins.data(), bins.size() * sizeof(real));
+}
+
+/**
+ * Reader of a file with results in the binary format. The file is mapped
+ * into the memory and the records are returned in place (no copying).
+ *
+ *     Result_file file;
+ *     if(file.open("results.bin")){
+ *         const Result_record_header* header;
+ *         while((header = file.next()) != nullptr){
+ *             const double* bins = Result_file::bins<double>(header);
+ *         }
+ *     }
+ */
+class Result_file{
+
+    const char* data;
+    size_t length;
+    size_t position; // offset of the next record
+
+public:
+
+    Result_file() : data(nullptr), length(0), position(0) {}
+
+    ~Result_file(){
+        close();
+    }
+
+    Result_file(const Result_file&) = delete;
+    Result_file& operator=(const Result_file&) = delete;
+
+    /**
+     * Maps the file into the memory. Returns bool (success)
+     */
+    bool open(const char* path){
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0) return false;
+
+        struct stat info;
+        if(fstat(fd, &info) < 0){
+            ::close(fd);
+            return false;
+        }
+        length = info.st_size;
+        if(length > 0){
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapped == MAP_FAILED){
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            data = (const char*)mapped;
+            madvise(mapped, length, MADV_SEQUENTIAL);
+        }
+        ::close(fd); // the mapping stays valid
+        return true;
+    }
+
+    void close(){
+        if(data != nullptr) munmap((void*)data, length);
+        data = nullptr;
+        length = 0;
+        position = 0;
+    }
+
+    /**
+     * Returns the next record or nullptr at the end of the file
+     * (or when the rest of the file is not a valid record).
+     */
+    const Result_record_header* next(){
+        if(position + sizeof(Result_record_header) > length) return nullptr;
+        const Result_record_header* header = (const Result_record_header*)(data + position);
+        if(!valid_result_record(header, length - position)) return nullptr;
+
+        position += header->size;
+        return header;
+    }
+
+    /**
+     * Whether all records were read (after next() returned nullptr, false
+     * means that the rest of the file is not a valid record).
+     */
+    bool at_end() const{
+        return position >= length;
+    }
+
+    /**
+     * Goes back to the first record.
+     */
+    void rewind(){
+        position = 0;
+    }
+
+    /**
+     * Returns the bins of the record or nullptr when they are not
+     * of the type real.
+     */
+    template <typename real>
+    static const real* bins(const Result_record_header* header){
+        if(header->real_type != result_real_type<real>()) return nullptr;
+        return (const real*)(header + 1);
+    }
+};
+
+#endif
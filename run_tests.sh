@@ -11,6 +11,17 @@ test_prefix() {
     echo "Return code is: $?"
 }
 
+# params:
+#   - infix input
+#   - expected output
+test_lazy() {
+    echo "---------------------------------------------------------------------"
+    echo "Input for lazy test is: $1"
+    echo "$1" | ./aprox -l -b 0.1
+    echo "EXPECTED OUTPUT: $2"
+    echo "Return code is: $?"
+}
+
 # params:
 #   - infix input
 #   - expected output
@@ -73,4 +84,146 @@ test_infix "10 n 5" "ERROR"
 test_infix "10 u 5" "ERROR"
 test_infix "3 n 10 / (-2) u 0" "ERROR"
 test_infix "3 n 10 / 0 u 2" "ERROR"
-test_infix "3 n 10 / -2 u 2" "ERROR"
\ No newline at end of file
+test_infix "3 n 10 / -2 u 2" "ERROR"
+
+echo "################################################ VARIABLES ###############################################"
+test_infix "let lat = 10 ~ 50; lat * 2 + lat / 3" "23 ... 117"
+test_infix "let k = 3 * 2; let d = k u 12; d + k" "12 ... 18"
+test_prefix "let lat = 10 50 ~; lat 2 * lat 3 / +" "23 ... 117"
+test_infix "let x = 2; y + 1" "ERROR"
+test_infix "let n = 1; 5" "ERROR"
+test_infix "3 u5" "3 ... 5"
+
+echo "################################################ LAZY ####################################################"
+test_lazy "0 ~ 1000 + 0 ~ 1000" "0 ... 2000"
+test_lazy "10 ~ 50 / 100" "0.1 ... 0.5"
+test_lazy "(-5) ~ 10 * 3 u 7" "-35 ... 70"
+test_lazy "5 + 3 * 2" "11"
+test_lazy "3 n 10 / (-2) u 0" "ERROR"
+test_lazy "let a = 0 ~ 1000 * 0 ~ 1000; 1 ~ 2" "1 ... 2"
+
+echo "################################################ SWEEP ###################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for sweep test is: 0 ~ 100 + 0 ~ 10 --sweep 3=10:20:10"
+echo "0 ~ 100 + 0 ~ 10" | ./aprox -r 5 --sweep 3=10:20:10
+echo "EXPECTED OUTPUT: 0 ... 110, 0 ... 120"
+echo "Input for sweep test is: (-5) ~ 10 --sweep 0=2:2:1 (the leaf 0 is 5)"
+echo "(-5) ~ 10" | ./aprox -r 5 --sweep 0=2:2:1
+echo "EXPECTED OUTPUT: -2 ... 10"
+
+echo "################################################ BATCH ###################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for batch test is: 3 lines"
+printf '1 + 2\n5 +\n0 ~ 10 * 2\n' | ./aprox -r 3 --batch
+echo "EXPECTED OUTPUT: LINE 1 3, LINE 2 ERROR, LINE 3 0 ... 20"
+
+echo "################################################ SERVE ###################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for serve test is: 2 requests"
+./aprox --serve /tmp/aprox_test.sock &
+sleep 1
+printf '0 ~ 10 * 2\n5 +\n' | ./tools/aprox_client -r 3 /tmp/aprox_test.sock
+printf '1\n' > /tmp/aprox_test_file.txt
+echo "@/tmp/aprox_test_file.txt + 0" | ./tools/aprox_client -r 3 /tmp/aprox_test.sock | head -1
+printf '7\n' > /tmp/aprox_test_file.txt
+echo "@/tmp/aprox_test_file.txt + 0" | ./tools/aprox_client -r 3 /tmp/aprox_test.sock | head -1
+kill $!
+echo "EXPECTED OUTPUT: 0 ~ 20, ERROR, 1 ~ 1, 7 ~ 7 (the changed file is read again)"
+
+echo "################################################ BINARY FORMAT ###########################################"
+echo "---------------------------------------------------------------------"
+echo "Input for binary format test is: 3 lines"
+printf '1 + 2\n5 +\n0 ~ 10 * 2\n' | ./aprox --batch --format=bin > /tmp/aprox_test.bin
+./tools/aprox_read /tmp/aprox_test.bin
+echo "EXPECTED OUTPUT: LINE 1 mean 3, LINE 2 ERROR, LINE 3 21 bins mean 10"
+echo "Input for binary format test is: the same file truncated"
+head -c 150 /tmp/aprox_test.bin > /tmp/aprox_test_truncated.bin
+./tools/aprox_read /tmp/aprox_test_truncated.bin
+echo "EXPECTED OUTPUT: LINE 1 mean 3, LINE 2 ERROR, ERROR: INVALID OR TRUNCATED RECORD"
+
+echo "################################################ CSV AND JSON ############################################"
+echo "---------------------------------------------------------------------"
+echo "Input for json test is: 0 u 2"
+echo "0 u 2" | ./aprox --format=json -r -1
+echo "EXPECTED OUTPUT: mean 1, variance 0.666667, 3 bins with probability 0.333333"
+echo "Input for csv test is: 2 lines"
+printf '1 + 2\n5 +\n' | ./aprox --batch --format=csv | grep -v ",q"
+echo "EXPECTED OUTPUT: header, 1,bin,3,3,1, mean 3, variance 0, 2,error"
+
+echo "################################################ EMPIRICAL ###############################################"
+printf 'value,weight\n10,1\n20,2\n30,1\n' > /tmp/aprox_test.csv
+test_infix "@/tmp/aprox_test.csv + 5" "15 ... 35"
+test_prefix "@/tmp/aprox_test.csv 2 *" "20 ... 60"
+test_lazy "@/tmp/aprox_test.csv + 0 ~ 10" "10 ... 40"
+test_infix "@/tmp/aprox_missing.csv + 1" "ERROR"
+printf '1\ninf\n2\nnan\n-inf\n3,inf\n' > /tmp/aprox_test_nonfinite.csv
+test_infix "@/tmp/aprox_test_nonfinite.csv + 5" "6 ... 7"
+printf '0\n1e10\n' > /tmp/aprox_test_outlier.csv
+test_infix "@/tmp/aprox_test_outlier.csv + 1" "ERROR"
+test_lazy "@/tmp/aprox_test_outlier.csv + 1" "ERROR"
+
+echo "################################################ SNAPSHOT ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for snapshot test is: 0 ~ 100 * 0 ~ 100 (computed, then loaded)"
+rm -rf /tmp/aprox_test_snapshots
+echo "0 ~ 100 * 0 ~ 100" | ./aprox -r 5 --snapshot /tmp/aprox_test_snapshots > /tmp/aprox_test_computed.txt
+echo "0 ~ 100 * 0 ~ 100" | ./aprox -r 5 --snapshot /tmp/aprox_test_snapshots > /tmp/aprox_test_loaded.txt
+cmp /tmp/aprox_test_computed.txt /tmp/aprox_test_loaded.txt && echo "SAME RESULTS, STORED: $(ls /tmp/aprox_test_snapshots | wc -l)"
+echo "EXPECTED OUTPUT: SAME RESULTS, STORED: 1"
+echo "Input for snapshot test is: the same with the stored file truncated (computed again)"
+truncate -s 100 /tmp/aprox_test_snapshots/*.dist
+echo "0 ~ 100 * 0 ~ 100" | ./aprox -r 5 --snapshot /tmp/aprox_test_snapshots > /tmp/aprox_test_loaded.txt
+cmp /tmp/aprox_test_computed.txt /tmp/aprox_test_loaded.txt && echo "SAME RESULTS"
+echo "EXPECTED OUTPUT: SAME RESULTS"
+
+echo "################################################ SPILL ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for spill test is: 0 ~ 1000 + 0 u 3000 - 10 ~ 20 (in memory and out of core)"
+echo "0 ~ 1000 + 0 u 3000 - 10 ~ 20" | ./aprox > /tmp/aprox_test_memory.txt
+echo "0 ~ 1000 + 0 u 3000 - 10 ~ 20" | ./aprox --spill /tmp/aprox_test_spill > /tmp/aprox_test_spilled.txt
+cmp /tmp/aprox_test_memory.txt /tmp/aprox_test_spilled.txt && echo "SAME RESULTS"
+echo "EXPECTED OUTPUT: SAME RESULTS"
+echo "Input for spill test is: let y = 0 ~ 10 * 0 ~ 10; 0 ~ 10 + 0 ~ 10 (unused binding with *)"
+echo "let y = 0 ~ 10 * 0 ~ 10; 0 ~ 10 + 0 ~ 10" | ./aprox > /tmp/aprox_test_memory.txt
+echo "let y = 0 ~ 10 * 0 ~ 10; 0 ~ 10 + 0 ~ 10" | ./aprox --spill /tmp/aprox_test_spill > /tmp/aprox_test_spilled.txt
+cmp /tmp/aprox_test_memory.txt /tmp/aprox_test_spilled.txt && echo "SAME RESULTS"
+echo "EXPECTED OUTPUT: SAME RESULTS"
+
+echo "################################################ STATS ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for stats test is: 0 ~ 10 * 0 ~ 10 + 5 (number of steps)"
+echo "0 ~ 10 * 0 ~ 10 + 5" | ./aprox --stats 2>&1 >/dev/null | grep "TOTAL" | cut -d, -f1
+echo "EXPECTED OUTPUT: TOTAL: 4 STEPS"
+
+echo "################################################ TRACE ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for trace test is: 0 ~ 10 * 0 ~ 10 + 5 (number of operator spans)"
+echo "0 ~ 10 * 0 ~ 10 + 5" | ./aprox --trace /tmp/aprox_test_trace.json > /dev/null
+grep -o '"name":"operator' /tmp/aprox_test_trace.json | wc -l
+echo "EXPECTED OUTPUT: 4"
+
+echo "################################################ MEMORY LIMIT ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for memory limit test is: 0 ~ 100 * 0 ~ 100 with -b 0.1 and --mem-limit 2M (coarser bin size)"
+echo "0 ~ 100 * 0 ~ 100" | ./aprox -b 0.1 -r 5 --mem-limit 2M 2>&1 >/dev/null | cut -d'(' -f1
+echo "EXPECTED OUTPUT: WARNING: MEMORY LIMIT - OPERATOR * COMPUTED WITH BIN SIZE 0.5 INSTEAD OF 0.1 "
+
+echo "################################################ HWCOUNTERS ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for hardware counters test is: 0 ~ 10 * 0 ~ 10 + 5 (number of steps)"
+echo "0 ~ 10 * 0 ~ 10 + 5" | ./aprox --hwcounters 2>&1 >/dev/null | grep -E "^total|^ERROR" | awk '{print $1, $2}'
+echo "EXPECTED OUTPUT: total 4 (ERROR: HARDWARE on machines without the counters, i.e. in a VM)"
+
+echo "################################################ EXPLAIN ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for explain test is: 0 ~ 100 * 0 ~ 100 + 5 (estimated cost)"
+echo "0 ~ 100 * 0 ~ 100 + 5" | ./aprox --explain | tail -1
+echo "EXPECTED OUTPUT: ESTIMATE: 20404 OPERATIONS, PEAK MEMORY 960096 B, RESULT 10001 BINS"
+
+echo "################################################ MAX COST ################################################"
+echo "---------------------------------------------------------------------"
+echo "Input for max cost test is: 0 ~ 100 * 0 ~ 100 + 5 with --max-cost 10000 (rejected, coarsened with --coarsen)"
+echo "0 ~ 100 * 0 ~ 100 + 5" | ./aprox --max-cost 10000 2>&1 >/dev/null | head -1
+echo "0 ~ 100 * 0 ~ 100 + 5" | ./aprox --max-cost 10000 --coarsen 2>&1 >/dev/null
+echo "EXPECTED OUTPUT: ERROR: ESTIMATED COST 20404 OPERATIONS EXCEEDS THE LIMIT 10000, EXPRESSION NOT COMPUTED."
+echo "                 WARNING: MAX COST - EXPRESSION COMPUTED WITH BIN SIZE 2 INSTEAD OF 1 (ESTIMATED 5304 OPERATIONS, 20404 WITH BIN SIZE 1)."
\ No newline at end of file
@@ -0,0 +1,263 @@
+#ifndef SERVER_HPP_
+#define SERVER_HPP_
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <csignal>
+#include <poll.h>
+#include "expression.hpp"
+#include "cache.hpp"
+#include "pipeline.hpp"
+#include "protocol.hpp"
+
+// how many leaf distributions and results are kept by the server
+#define SERVER_LEAF_CACHE_SIZE 256
+#define SERVER_RESULT_CACHE_SIZE 4096
+
+// at most this many bytes of results are kept (a result with -r 0 and a fine grid can have megabytes)
+#define SERVER_RESULT_CACHE_BYTES (64 << 20)
+
+// a worker waits at most this long for the rest of a request or for the client to read the response
+#define SERVER_TIMEOUT_SECONDS 10
+
+// connections waiting for a free worker
+#define SERVER_BACKLOG 128
+
+// set by SIGINT and SIGTERM
+static volatile sig_atomic_t server_stop_requested = 0;
+
+inline void server_stop(int){
+    server_stop_requested = 1;
+}
+
+/**
+ * Server answering requests over a Unix socket (see protocol.hpp).
+ *
+ * The main thread accepts connections and waits (poll) until some of
+ * them sends a request. Such a connection is handed to the worker pool,
+ * the worker answers one request and returns the connection back to the
+ * main thread (through `returned` and a pipe that wakes up the poll).
+ * So any number of connections is served by a fixed number of workers.
+ * A client that stops in the middle of a request (or doesn't read the
+ * response) is disconnected after SERVER_TIMEOUT_SECONDS, so it doesn't
+ * hold the worker.
+ * Every worker has its own Expression, the leaf cache and the result cache
+ * are shared by all workers and stay warm for the whole life of the server.
+ */
+template <typename real>
+class Server{
+
+    Leaf_cache<real> leaf_cache;
+    Result_cache result_cache;
+    real std_deviation_quotient;
+
+    Bounded_queue<int> connections; // connections with a request
+    std::vector<int> returned; // connections returned by the workers
+    std::mutex returned_mutex;
+    int wakeup[2]; // pipe: a worker returned a connection
+
+public:
+
+    // expressions over the estimated cost are rejected or coarsened (if set)
+    const Cost_limit* cost_limit = nullptr;
+
+    Server(real std_deviation_quotient) : leaf_cache(SERVER_LEAF_CACHE_SIZE),
+                                          result_cache(SERVER_RESULT_CACHE_SIZE, SERVER_RESULT_CACHE_BYTES),
+                                          std_deviation_quotient(std_deviation_quotient),
+                                          connections(SERVER_BACKLOG) {}
+
+    /**
+     * Listens on the socket until SIGINT or SIGTERM.
+     * Returns bool (success), false when the socket can't be created.
+     */
+    bool serve(const char* path, unsigned int threads){
+        sockaddr_un address;
+        if(!socket_address(path, address)) return false;
+
+        int listening = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listening < 0) return false;
+        unlink(path);
+        if(bind(listening, (sockaddr*)&address, sizeof(address)) < 0 ||
+           listen(listening, SERVER_BACKLOG) < 0){
+            close(listening);
+            return false;
+        }
+
+        // poll() is interrupted by the signals (no SA_RESTART), the workers
+        // block them so that the main thread gets them
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = server_stop;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+
+        sigset_t signals, original;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, &original);
+
+        if(pipe(wakeup) < 0){
+            close(listening);
+            return false;
+        }
+        std::vector<std::thread> workers;
+        for(unsigned int i = 0; i < threads; i++){
+            workers.emplace_back([this]{ work(); });
+        }
+        pthread_sigmask(SIG_SETMASK, &original, nullptr);
+
+        std::vector<pollfd> waiting = {{wakeup[0], POLLIN, 0}, {listening, POLLIN, 0}};
+        while(!server_stop_requested){
+            if(poll(waiting.data(), waiting.size(), -1) < 0) continue;
+
+            // connections with a request (or closed by the client) go to the workers
+            for(size_t i = waiting.size() - 1; i >= 2; i--){
+                if(waiting[i].revents == 0) continue;
+                connections.push(std::move(waiting[i].fd));
+                waiting.erase(waiting.begin() + i);
+            }
+            if(waiting[1].revents & POLLIN){
+                int connection = accept(listening, nullptr, nullptr);
+                if(connection >= 0){
+                    timeval timeout = {SERVER_TIMEOUT_SECONDS, 0};
+                    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                    setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    waiting.push_back({connection, POLLIN, 0});
+                }
+            }
+            if(waiting[0].revents & POLLIN){
+                char buffer[64];
+                if(read(wakeup[0], buffer, sizeof(buffer)) < 0) continue;
+
+                std::lock_guard<std::mutex> lock(returned_mutex);
+                for(int connection : returned) waiting.push_back({connection, POLLIN, 0});
+                returned.clear();
+            }
+            for(auto&& fd : waiting) fd.revents = 0;
+        }
+
+        // stop: finish the requests being evaluated and close everything
+        connections.close();
+        for(auto&& worker : workers) worker.join();
+        for(size_t i = 2; i < waiting.size(); i++) close(waiting[i].fd);
+        for(int connection : returned) close(connection);
+        close(wakeup[0]);
+        close(wakeup[1]);
+        close(listening);
+        unlink(path);
+        return true;
+    }
+
+private:
+
+    /**
+     * Worker: answers one request of each connection from the queue.
+     */
+    void work(){
+        Expression<real> expression(1, std_deviation_quotient);
+        expression.leaf_cache = &leaf_cache;
+        expression.cost_limit = cost_limit;
+        std::stringstream input;
+        std::stringstream output;
+        std::vector<real> bins;
+        std::string text;
+        std::string key;
+        std::string response;
+
+        int connection;
+        while(connections.pop(connection)){
+            if(!answer(connection, expression, input, output, bins, text, key, response)){
+                close(connection);
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(returned_mutex);
+            returned.push_back(connection);
+            if(write(wakeup[1], "", 1) < 0) continue;
+        }
+    }
+
+    /**
+     * Reads one request and sends the response.
+     * Returns false when the connection should be closed.
+     */
+    bool answer(int connection, Expression<real>& expression, std::stringstream& input,
+                std::stringstream& output, std::vector<real>& bins, std::string& text,
+                std::string& key, std::string& response){
+        Request_header request;
+        if(!read_all(connection, &request, sizeof(request))) return false;
+        if(request.length > PROTOCOL_MAX_REQUEST) return false;
+        text.resize(request.length);
+        if(!read_all(connection, &text[0], request.length)) return false;
+
+        // results with files (@path) are not cached, the file can change while the request
+        // stays the same (the binned files are cached by Empirical_cache, which checks them)
+        if(text.find('@') != std::string::npos){
+            response = evaluate(request, text, expression, input, output, bins);
+            return write_all(connection, response.data(), response.size());
+        }
+
+        // the key of the result cache is the whole request
+        key.assign((const char*)&request, sizeof(request));
+        key += text;
+
+        if(!result_cache.get(key, response)){
+            response = evaluate(request, text, expression, input, output, bins);
+            result_cache.put(key, response);
+        }
+        return write_all(connection, response.data(), response.size());
+    }
+
+    /**
+     * Evaluates the request and returns the whole response (header and result).
+     */
+    std::string evaluate(const Request_header& request, const std::string& text, Expression<real>& expression,
+                         std::stringstream& input, std::stringstream& output, std::vector<real>& bins){
+        expression.reset();
+        expression.bin_size = request.bin_size > 0 ? request.bin_size : 1;
+        expression.lazy = request.flags & PROTOCOL_LAZY;
+        input.clear();
+        input.str(text);
+        output.clear();
+        output.str("");
+
+        Response_header header = {PROTOCOL_OK, 0};
+        const Token<real>* result = nullptr;
+        if(expression.parse_input(input, request.flags & PROTOCOL_POSTFIX) &&
+           expression.evaluate(request.num_of_result_bins)){
+            result = expression.result();
+        }
+
+        if(result == nullptr){
+            header.status = PROTOCOL_ERROR;
+            output << "ERROR OCCURRED DURING COMPUTATION.";
+        }
+        else if(request.flags & PROTOCOL_BINARY){
+            Binary_result_header binary = {(double)result->get_number(), 0, 1};
+            if(result->get_distribution() != nullptr){
+                binary.count = result->get_distribution()->to_bins(bins);
+                binary.origin = result->get_distribution()->get_from();
+                binary.bin_size = result->get_distribution()->get_bin_size();
+            }
+            else bins.assign(1, 1);
+
+            output.write((const char*)&binary, sizeof(binary));
+            for(real bin : bins){
+                double value = bin;
+                output.write((const char*)&value, sizeof(value));
+            }
+        }
+        else result->print(output, request.num_of_result_bins);
+
+        std::string body = output.str();
+        header.length = body.size();
+        return std::string((const char*)&header, sizeof(header)) + body;
+    }
+};
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef SESSION_HPP_
+#define SESSION_HPP_
+
+#include <vector>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include "expression.hpp"
+
+/**
+ * New value of one number in the expression. Numbers (leaves) are indexed
+ * from 0 in the order in which they appear in the input, i.e. in `0 100 ~`
+ * the number 100 is the leaf 1. Zeros inserted by the parser before
+ * a unary minus are not leaves, in `(-5) ~ 10` the number 5 is the leaf 0.
+ */
+template <typename real>
+struct Leaf_update{
+    size_t leaf;
+    real value;
+};
+
+/**
+ * Values of the nodes changed by Session::evaluate_with(). Every thread
+ * evaluating the same session has its own scratch.
+ */
+template <typename real>
+struct Session_scratch{
+    std::vector<Token<real>> values;
+    std::vector<char> changed;
+    std::vector<std::string> texts; // canonical texts (only with the snapshot store)
+};
+
+/**
+ * Evaluation session for an expression that is evaluated many times with
+ * different values of its numbers.
+ *
+ * The expression is parsed into the Expression_tree once and the value of
+ * every node is kept. When some leaves change, only the nodes that depend
+ * on them (the paths from the leaves to the root) are recomputed.
+ * In general returns false on failure and true on success.
+ */
+template <typename real>
+class Session{
+
+    Expression_tree<real> tree;
+    std::vector<Token<real>> values; // value of every node
+    std::vector<std::vector<int>> dependents; // nodes that use the node as an operand
+    std::vector<int> leaves; // node of each leaf
+    std::vector<bool> dirty; // the value has to be recomputed
+    std::vector<std::string> texts; // canonical texts (only with the snapshot store)
+
+    real bin_size;
+    real std_deviation_quotient;
+
+public:
+
+    // leaf distributions are taken from the cache if it is set
+    Leaf_cache<real>* leaf_cache = nullptr;
+
+    // results of the operators are stored and loaded if it is set
+    const Snapshot_store<real>* snapshots = nullptr;
+
+    Session(real bin_size, real std_deviation_quotient) : bin_size(bin_size),
+                                std_deviation_quotient(std_deviation_quotient){}
+
+    /**
+     * Parses the expression (with possible let bindings) and evaluates it.
+     * Returns bool (success of the parsing)
+     */
+    bool load(std::stringstream& input, bool postfix){
+        Expression<real> parser(bin_size, std_deviation_quotient, true);
+        if(!parser.parse_input(input, postfix)) return false;
+        tree = std::move(parser.get_tree());
+        if(tree.root() < 0) return false;
+
+        values.clear();
+        values.resize(tree.size());
+        dependents.assign(tree.size(), std::vector<int>());
+        leaves.clear();
+        dirty.assign(tree.size(), true);
+        texts.assign(tree.size(), std::string());
+
+        for(size_t i = 0; i < tree.size(); i++){
+            Node<real>& node = tree[i];
+            node.grid = bin_size;
+            if(node.op == 0 && !node.implicit) leaves.push_back(i);
+            if(node.left >= 0) dependents[node.left].push_back(i);
+            if(node.right >= 0) dependents[node.right].push_back(i);
+        }
+
+        recompute();
+        return true;
+    }
+
+    size_t num_of_leaves() const{
+        return leaves.size();
+    }
+
+    real leaf_value(size_t leaf) const{
+        return tree[leaves[leaf]].number;
+    }
+
+    /**
+     * Changes values of the leaves and recomputes the nodes depending on them.
+     * Returns bool (success), false when some leaf doesn't exist.
+     */
+    bool update(const std::vector<Leaf_update<real>>& updates){
+        for(auto&& update : updates){
+            if(update.leaf >= leaves.size()) return false;
+        }
+        for(auto&& update : updates){
+            int index = leaves[update.leaf];
+            tree[index].number = update.value;
+            mark_dirty(index);
+        }
+        recompute();
+        return true;
+    }
+
+    /**
+     * Evaluates the expression with the leaves changed by updates, but the
+     * session itself stays unchanged, so more threads can call it at once.
+     * Only the nodes depending on the updated leaves are computed (into
+     * the scratch), values of the other nodes are shared.
+     * Returns the value of the whole expression.
+     */
+    const Token<real>& evaluate_with(const std::vector<Leaf_update<real>>& updates,
+                                     Session_scratch<real>& scratch) const{
+        scratch.values.resize(tree.size());
+        scratch.changed.assign(tree.size(), 0);
+
+        if(snapshots != nullptr) scratch.texts.resize(tree.size());
+
+        for(auto&& update : updates){
+            if(update.leaf >= leaves.size()) continue;
+            int index = leaves[update.leaf];
+            scratch.changed[index] = 1;
+            scratch.values[index] = Token<real>(update.value);
+            if(snapshots != nullptr) scratch.texts[index] = Expression_tree<real>::number_text(update.value);
+        }
+
+        for(size_t i = 0; i < tree.size(); i++){
+            const Node<real>& node = tree[i];
+            if(node.op == 0 || node.op == '@') continue;
+            if(node.op == 'v'){
+                scratch.changed[i] = scratch.changed[node.left];
+                continue;
+            }
+            if(!scratch.changed[node.left] && !scratch.changed[node.right]) continue;
+
+            scratch.changed[i] = 1;
+            if(snapshots != nullptr) scratch.texts[i] = tree.node_text(i, text(node.left, scratch), text(node.right, scratch));
+            scratch.values[i] = compute(i, value(node.left, scratch), value(node.right, scratch),
+                                        snapshots != nullptr ? scratch.texts[i] : texts[i]);
+        }
+        return value(tree.root(), scratch);
+    }
+
+    /**
+     * Returns the value of the whole expression.
+     */
+    const Token<real>& result(){
+        return value(tree.root());
+    }
+
+    /**
+     * Returns the value of a node (a reference to a variable returns the
+     * value of the bound subtree).
+     */
+    const Token<real>& value(int index){
+        while(tree[index].op == 'v') index = tree[index].left;
+        return values[index];
+    }
+
+    /**
+     * Prints the value of the whole expression.
+     */
+    bool print_result(std::ostream& ostr, int num_of_result_bins){
+        const Token<real>& root = result();
+        if(root.error_occurred) return false;
+        root.print(ostr, num_of_result_bins);
+        return true;
+    }
+
+private:
+
+    /**
+     * Returns the value of a node - from the scratch if it was changed.
+     */
+    const Token<real>& value(int index, const Session_scratch<real>& scratch) const{
+        while(tree[index].op == 'v') index = tree[index].left;
+        return scratch.changed[index] ? scratch.values[index] : values[index];
+    }
+
+    /**
+     * Returns the canonical text of a node - from the scratch if it was changed.
+     */
+    const std::string& text(int index, const Session_scratch<real>& scratch) const{
+        while(tree[index].op == 'v') index = tree[index].left;
+        return scratch.changed[index] ? scratch.texts[index] : texts[index];
+    }
+
+    /**
+     * Computes the operator of the node. With the snapshot store the result
+     * is loaded if it is stored, computed results that took long are stored.
+     */
+    Token<real> compute(size_t index, const Token<real>& left, const Token<real>& right,
+                        const std::string& text) const{
+        const Node<real>& node = tree[index];
+        if(snapshots == nullptr || !node.is_storable()){
+            return Token<real>::operation(left, right, node.op, bin_size, std_deviation_quotient, leaf_cache);
+        }
+
+        std::string key = snapshots->key(text, std_deviation_quotient);
+        std::unique_ptr<Distribution<real>> stored = snapshots->load(key);
+        if(stored != nullptr) return Token<real>(std::move(stored));
+
+        auto start = std::chrono::steady_clock::now();
+        Token<real> result = Token<real>::operation(left, right, node.op, bin_size, std_deviation_quotient, leaf_cache);
+        if(!result.error_occurred && result.get_distribution() != nullptr &&
+           std::chrono::steady_clock::now() - start >= std::chrono::microseconds(SNAPSHOT_MIN_MICROSECONDS)){
+            snapshots->save(key, *result.get_distribution());
+        }
+        return result;
+    }
+
+    /**
+     * Marks the node and everything that depends on it.
+     */
+    void mark_dirty(int index){
+        std::vector<int> stack(1, index);
+        while(!stack.empty()){
+            int current = stack.back();
+            stack.pop_back();
+            if(dirty[current]) continue;
+            dirty[current] = true;
+            for(int dependent : dependents[current]) stack.push_back(dependent);
+        }
+    }
+
+    /**
+     * Recomputes all dirty nodes. Children precede their parents in the
+     * tree, so one pass in the order of the nodes is enough.
+     */
+    void recompute(){
+        for(size_t i = 0; i < tree.size(); i++){
+            if(!dirty[i]) continue;
+            dirty[i] = false;
+
+            Node<real>& node = tree[i];
+            if(snapshots != nullptr){
+                texts[i] = tree.node_text(i, node.left >= 0 ? texts[node.left] : std::string(),
+                                          node.right >= 0 ? texts[node.right] : std::string());
+            }
+            if(node.op == 0) values[i] = Token<real>(node.number);
+            else if(node.op == 'v') continue;
+            else if(node.op == '@') values[i] = Token<real>(Empirical_cache<real>::instance().get(tree.file(node), bin_size));
+            else values[i] = compute(i, value(node.left), value(node.right), texts[i]);
+        }
+    }
+};
+
+#endif
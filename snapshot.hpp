@@ -0,0 +1,182 @@
+#ifndef SNAPSHOT_HPP_
+#define SNAPSHOT_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "distribution.hpp"
+#include "result_format.hpp"
+
+/**
+ * On-disk store of evaluated distributions (`--snapshot DIR`), so that
+ * a restarted job loads expensive intermediate results instead of
+ * computing them again.
+ *
+ * The store is content-addressed: the key of a distribution is the
+ * canonical text of its subexpression (postfix, with the grid of every
+ * node and the identity of the files, see Expression_tree::node_text())
+ * together with the engine version, the type real and the standard
+ * deviation quotient. The file name is a hash of the key, the whole key
+ * is stored in the file and compared when the file is loaded.
+ *
+ * A file is written into a temporary file which is then renamed, so more
+ * threads or processes can share the store.
+ */
+
+// has to be changed whenever the results of the operators change
+#define APROX_ENGINE_VERSION 1
+
+#define SNAPSHOT_MAGIC 0x4e535041 // "APSN"
+
+// only distributions whose computation took longer are stored
+#define SNAPSHOT_MIN_MICROSECONDS 1000
+
+struct Snapshot_header{
+    uint32_t magic;
+    uint16_t engine_version;
+    uint16_t real_type; // RESULT_REAL_*
+    uint64_t key_length;
+    uint64_t count; // number of bins
+    double bin_size;
+    // followed by the key and count pairs (value, probability) of the type real
+};
+
+template <typename real>
+class Snapshot_store{
+
+    std::string directory;
+
+public:
+
+    Snapshot_store(const std::string& directory) : directory(directory) {}
+
+    /**
+     * Creates the directory if it doesn't exist. Returns bool (success)
+     */
+    bool open() const{
+        if(mkdir(directory.c_str(), 0777) == 0) return true;
+        struct stat info;
+        return stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    }
+
+    /**
+     * Returns the key of a subexpression with the canonical text.
+     */
+    std::string key(const std::string& text, real std_deviation_quotient) const{
+        char number[64];
+        std::to_chars_result end = std::to_chars(number, number + sizeof(number), std_deviation_quotient);
+        return "aprox " + std::to_string(APROX_ENGINE_VERSION) + " " + std::to_string(sizeof(real)) +
+               " " + std::string(number, end.ptr - number) + " " + text;
+    }
+
+    bool contains(const std::string& key) const{
+        return access(path(key).c_str(), R_OK) == 0;
+    }
+
+    /**
+     * Returns the stored distribution or nullptr when it isn't stored (or
+     * the file is truncated or corrupt, then the distribution is computed).
+     */
+    std::unique_ptr<Distribution<real>> load(const std::string& key) const{
+        FILE* file = fopen(path(key).c_str(), "rb");
+        if(file == nullptr) return nullptr;
+
+        Snapshot_header header;
+        std::string stored_key;
+        typename Distribution<real>::Bins bins;
+        struct stat info;
+        bool success = fstat(fileno(file), &info) == 0 &&
+                       fread(&header, sizeof(header), 1, file) == 1 && header.magic == SNAPSHOT_MAGIC &&
+                       header.engine_version == APROX_ENGINE_VERSION &&
+                       header.real_type == result_real_type<real>() && header.key_length == key.size() &&
+                       fits(header, info.st_size);
+        if(success){
+            stored_key.resize(header.key_length);
+            success = fread(&stored_key[0], 1, stored_key.size(), file) == stored_key.size() && stored_key == key;
+        }
+        if(success){
+            std::vector<real> pairs(2 * header.count);
+            success = header.count > 0 && fread(pairs.data(), sizeof(real), pairs.size(), file) == pairs.size();
+            for(size_t i = 0; success && i < header.count; i++){
+                bins.emplace_hint(bins.end(), pairs[2 * i], pairs[2 * i + 1]);
+            }
+        }
+        fclose(file);
+        if(!success) return nullptr;
+        return std::make_unique<Distribution<real>>(std::move(bins), header.bin_size);
+    }
+
+    /**
+     * Stores the distribution. Returns bool (success)
+     */
+    bool save(const std::string& key, const Distribution<real>& distribution) const{
+        if(distribution.error_occurred) return false;
+
+        Snapshot_header header;
+        memset(&header, 0, sizeof(header));
+        header.magic = SNAPSHOT_MAGIC;
+        header.engine_version = APROX_ENGINE_VERSION;
+        header.real_type = result_real_type<real>();
+        header.key_length = key.size();
+        header.count = distribution.get_bins().size();
+        header.bin_size = distribution.get_bin_size();
+
+        std::vector<real> pairs;
+        pairs.reserve(2 * header.count);
+        for(auto&& element : distribution.get_bins()){
+            pairs.push_back(element.first);
+            pairs.push_back(element.second);
+        }
+
+        // the temporary file is unique for the process and the thread
+        std::string final_path = path(key);
+        std::string temporary_path = final_path + "." + std::to_string(getpid()) + "." +
+                                     std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        FILE* file = fopen(temporary_path.c_str(), "wb");
+        if(file == nullptr) return false;
+        bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(key.data(), 1, key.size(), file) == key.size() &&
+                       fwrite(pairs.data(), sizeof(real), pairs.size(), file) == pairs.size();
+        success = fclose(file) == 0 && success;
+        if(success) success = rename(temporary_path.c_str(), final_path.c_str()) == 0;
+        if(!success) unlink(temporary_path.c_str());
+        return success;
+    }
+
+private:
+
+    /**
+     * Whether the file of the size has exactly the key and the bins of the
+     * header (checked before anything is allocated by the header).
+     */
+    static bool fits(const Snapshot_header& header, off_t size){
+        if(size < (off_t)sizeof(header) || (uint64_t)size - sizeof(header) < header.key_length) return false;
+        uint64_t rest = (uint64_t)size - sizeof(header) - header.key_length;
+        return rest % (2 * sizeof(real)) == 0 && header.count == rest / (2 * sizeof(real));
+    }
+
+    /**
+     * Path of the file with the key (64-bit FNV-1a hash of the key).
+     */
+    std::string path(const std::string& key) const{
+        uint64_t hash = 14695981039346656037ULL;
+        for(unsigned char character : key){
+            hash ^= character;
+            hash *= 1099511628211ULL;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.dist", (unsigned long long)hash);
+        return directory + "/" + name;
+    }
+};
+
+#endif
@@ -0,0 +1,427 @@
+#ifndef SPILL_HPP_
+#define SPILL_HPP_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/math/distributions/normal.hpp>
+#include "expression.hpp"
+
+/**
+ * Out-of-core distributions (`--spill DIR`) for grids that don't fit into
+ * the memory.
+ *
+ * A spilled distribution is a dense array of bins with 64-bit indices:
+ * bin i is the value origin + i * bin_size. The array is stored in a file
+ * in DIR (removed right after it is created, so it disappears with the
+ * process) and it is accessed through Spill_cursor, which maps one chunk
+ * of SPILL_CHUNK_BINS bins at a time. All kernels go through the bins
+ * in order with a few cursors, so the memory is bounded by a few chunks
+ * and the disk is read and written sequentially.
+ *
+ * Supported are the leaf distributions ('~', 'n', 'u'), empirical
+ * distributions (@path), + and - of distributions and numbers (the same
+ * operations as Distribution computes, only on the dense grid).
+ * Products and quotients don't keep the grid, so they are not supported.
+ */
+
+// bins in one mapped chunk (a power of two, 8 MiB of doubles)
+#define SPILL_CHUNK_SHIFT 20
+#define SPILL_CHUNK_BINS ((uint64_t)1 << SPILL_CHUNK_SHIFT)
+
+/**
+ * Anonymous file with count bins in the spill directory.
+ */
+template <typename real>
+class Spill_file{
+
+    int fd;
+    uint64_t count;
+
+public:
+
+    Spill_file() : fd(-1), count(0) {}
+
+    Spill_file(const Spill_file&) = delete;
+    Spill_file& operator=(const Spill_file&) = delete;
+
+    ~Spill_file(){
+        if(fd >= 0) close(fd);
+    }
+
+    /**
+     * Creates the file with count zero bins. Returns bool (success)
+     */
+    bool create(const std::string& directory, uint64_t count){
+        std::string path = directory + "/aprox-spill-XXXXXX";
+        fd = mkstemp(&path[0]);
+        if(fd < 0) return false;
+        unlink(path.c_str());
+
+        this->count = count;
+        return ftruncate(fd, count * sizeof(real)) == 0;
+    }
+
+    int descriptor() const{
+        return fd;
+    }
+
+    uint64_t size() const{
+        return count;
+    }
+};
+
+/**
+ * Access to the bins of a Spill_file through one mapped chunk. The chunk
+ * is remapped when an index from another chunk is accessed, so the cursor
+ * should go through the bins in order (forward or backward).
+ */
+template <typename real>
+class Spill_cursor{
+
+    const Spill_file<real>* file;
+    bool writable;
+    uint64_t chunk;
+    real* data;
+    size_t length; // mapped bytes
+
+public:
+
+    Spill_cursor(const Spill_file<real>& file, bool writable = false) : file(&file),
+                                                                         writable(writable),
+                                                                         chunk(UINT64_MAX),
+                                                                         data(nullptr),
+                                                                         length(0) {}
+
+    Spill_cursor(const Spill_cursor&) = delete;
+    Spill_cursor& operator=(const Spill_cursor&) = delete;
+
+    ~Spill_cursor(){
+        unmap();
+    }
+
+    /**
+     * Returns the bin (a reference valid until another chunk is accessed).
+     * When the chunk can't be mapped, the program ends.
+     */
+    real& operator[](uint64_t index){
+        if((index >> SPILL_CHUNK_SHIFT) != chunk) map(index >> SPILL_CHUNK_SHIFT);
+        return data[index & (SPILL_CHUNK_BINS - 1)];
+    }
+
+private:
+
+    void map(uint64_t new_chunk){
+        unmap();
+        chunk = new_chunk;
+        uint64_t first = chunk << SPILL_CHUNK_SHIFT;
+        length = std::min(SPILL_CHUNK_BINS, file->size() - first) * sizeof(real);
+
+        void* mapped = mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                            MAP_SHARED, file->descriptor(), first * sizeof(real));
+        if(mapped == MAP_FAILED){
+            std::cerr << "ERROR: UNABLE TO MAP THE SPILL FILE." << std::endl;
+            std::exit(1);
+        }
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        data = (real*)mapped;
+    }
+
+    void unmap(){
+        if(data != nullptr) munmap(data, length);
+        data = nullptr;
+    }
+};
+
+/**
+ * Distribution stored in a Spill_file: bin i is the value origin + i * bin_size.
+ * Distributions shifted by a number share the file.
+ */
+template <typename real>
+struct Spilled_distribution{
+    std::shared_ptr<Spill_file<real>> file;
+    real origin;
+    real bin_size;
+
+    uint64_t size() const{
+        return file->size();
+    }
+
+    real get_to() const{
+        return origin + (real)(size() - 1) * bin_size;
+    }
+};
+
+/**
+ * Value of a node evaluated out of core - a number or a spilled distribution.
+ */
+template <typename real>
+struct Spilled_value{
+    bool is_number = true;
+    real number = 0;
+    Spilled_distribution<real> distribution;
+};
+
+/**
+ * Evaluates an Expression_tree with spilled distributions and prints the result.
+ * In general returns false on failure and true on success.
+ */
+template <typename real>
+class Spill_evaluator{
+
+    std::string directory;
+    real bin_size;
+    real std_deviation_quotient;
+
+public:
+
+    Spill_evaluator(const std::string& directory, real bin_size, real std_deviation_quotient) :
+                    directory(directory), bin_size(bin_size), std_deviation_quotient(std_deviation_quotient) {}
+
+    /**
+     * Creates the directory if it doesn't exist. Returns bool (success)
+     */
+    bool open() const{
+        if(mkdir(directory.c_str(), 0777) == 0) return true;
+        struct stat info;
+        return stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    }
+
+    /**
+     * Evaluates the tree in one pass (children precede their parents),
+     * bindings that the result doesn't use are skipped. Returns bool
+     * (success), false also for an unsupported operator.
+     */
+    bool evaluate(const Expression_tree<real>& tree, Spilled_value<real>& result){
+        if(tree.root() < 0) return false;
+
+        std::vector<Spilled_value<real>> values(tree.size());
+        std::vector<char> needed = tree.needed_nodes();
+        for(size_t i = 0; i < tree.size(); i++){
+            if(!needed[i]) continue;
+            const Node<real>& node = tree[i];
+            Spilled_value<real>& value = values[i];
+
+            if(node.op == 0){
+                value.number = node.number;
+            }
+            else if(node.op == 'v'){
+                value = values[node.left]; // the file is shared
+            }
+            else if(node.op == '@'){
+                auto loaded = Empirical_cache<real>::instance().get(tree.file(node), bin_size);
+                if(loaded->error_occurred || !store(*loaded, value)) return false;
+            }
+            else if(!operation(values[node.left], values[node.right], node.op, value)){
+                return false;
+            }
+        }
+        result = values[tree.root()];
+        return true;
+    }
+
+    /**
+     * Prints the result in the same way as Distribution::print(), the bins
+     * are summed into the printed bins in one pass.
+     */
+    void print(const Spilled_value<real>& value, std::ostream& ostr, int num_of_result_bins) const{
+        if(value.is_number){
+            ostr << value.number << '\n';
+            return;
+        }
+
+        const Spilled_distribution<real>& dist = value.distribution;
+        real from = dist.origin;
+        real to = dist.get_to();
+        ostr << "RESULT = " << from << " ~ " << to << '\n';
+        ostr << '\n';
+
+        Spill_cursor<real> bins(*dist.file);
+        bool keep_bins = num_of_result_bins < 1;
+        real width = keep_bins ? dist.bin_size : (to - from) / (num_of_result_bins - 1);
+
+        // a single value or a single printed bin
+        if(!(width > 0) || !std::isfinite(width)){
+            real sum = 0;
+            for(uint64_t i = 0; i < dist.size(); i++) sum += bins[i];
+            print_bin(ostr, from, sum);
+            return;
+        }
+
+        // every bin is printed, from the highest value
+        if(keep_bins){
+            for(uint64_t i = dist.size(); i-- > 0;) print_bin(ostr, from + (real)i * dist.bin_size, bins[i]);
+            return;
+        }
+
+        std::vector<real> printed(num_of_result_bins, 0);
+        for(uint64_t i = 0; i < dist.size(); i++){
+            long long index = std::llround((real)i * dist.bin_size / width);
+            printed[std::max(0LL, std::min<long long>(index, num_of_result_bins - 1))] += bins[i];
+        }
+        for(int k = num_of_result_bins; k-- > 0;) print_bin(ostr, from + k * width, printed[k]);
+    }
+
+private:
+
+    /**
+     * One line of the printed distribution (see Distribution::print()).
+     */
+    static void print_bin(std::ostream& ostr, real value, real probability){
+        int hvezd = probability / PRINT_BLOCK_PER_PROBABILITY;
+        ostr << std::right << std::setw(9) << std::round(value * DIVISION_ERROR) / DIVISION_ERROR << "  ";
+        for(int h = 0; h <= hvezd; h++) ostr << "*";
+        ostr << '\n';
+    }
+
+    /**
+     * Creates the spilled distribution with count zero bins.
+     */
+    bool create(uint64_t count, real origin, Spilled_value<real>& value) const{
+        value.is_number = false;
+        value.distribution.file = std::make_shared<Spill_file<real>>();
+        value.distribution.origin = origin;
+        value.distribution.bin_size = bin_size;
+        if(value.distribution.file->create(directory, count)) return true;
+
+        std::cerr << "ERROR: UNABLE TO CREATE A SPILL FILE IN " << directory << std::endl;
+        return false;
+    }
+
+    /**
+     * Copies a distribution (i.e. an empirical one) into a spilled distribution.
+     */
+    bool store(const Distribution<real>& distribution, Spilled_value<real>& value) const{
+        std::vector<real> bins;
+        distribution.to_bins(bins);
+        if(!create(bins.size(), distribution.get_from(), value)) return false;
+
+        Spill_cursor<real> result(*value.distribution.file, true);
+        for(uint64_t i = 0; i < bins.size(); i++) result[i] = bins[i];
+        return true;
+    }
+
+    /**
+     * Computes one operator. Returns bool (success)
+     */
+    bool operation(const Spilled_value<real>& left, const Spilled_value<real>& right, char op,
+                   Spilled_value<real>& value) const{
+        const Operator<real>* registered = Operator_registry<real>::find(op);
+        if(registered == nullptr) return false;
+
+        if(registered->leaf != nullptr){
+            if(!left.is_number || !right.is_number) return false;
+            return leaf(op, left.number, right.number, value);
+        }
+        if(left.is_number && right.is_number){
+            value.is_number = true;
+            return registered->number_number(left.number, right.number, value.number);
+        }
+
+        if(op != '+' && op != '-'){
+            std::cerr << "ERROR: ONLY + AND - OF DISTRIBUTIONS ARE SUPPORTED WITH --spill." << std::endl;
+            return false;
+        }
+
+        // a number shifts the distribution (number - distribution is computed
+        // as distribution - number, the same as Distribution does)
+        if(left.is_number || right.is_number){
+            value = left.is_number ? right : left;
+            real number = left.is_number ? left.number : right.number;
+            value.distribution.origin += op == '+' ? number : -number;
+            return true;
+        }
+        if(std::abs(left.distribution.bin_size - right.distribution.bin_size) > bin_size / DIVISION_ERROR){
+            return false;
+        }
+        return combine(left.distribution, right.distribution, op == '-', value);
+    }
+
+    /**
+     * Creates a leaf distribution bin by bin (the same values as the
+     * constructor of Distribution).
+     */
+    bool leaf(char op, real from_param, real to_param, Spilled_value<real>& value) const{
+        real from = std::llround(from_param / bin_size) * bin_size;
+        real to = std::llround(to_param / bin_size) * bin_size;
+        if(from > to) return false;
+
+        uint64_t count = std::llround((to - from) / bin_size) + 1;
+        if(!create(count, from, value)) return false;
+        Spill_cursor<real> result(*value.distribution.file, true);
+
+        if(count == 1 || op == 'u'){
+            for(uint64_t i = 0; i < count; i++) result[i] = (real)1 / count;
+            return true;
+        }
+
+        real mean = from + ((to - from) / 2);
+        auto dist = boost::math::normal_distribution<real>(mean, (mean - from) / std_deviation_quotient);
+        for(uint64_t i = 0; i < count; i++) result[i] = boost::math::pdf(dist, from + (real)i * bin_size);
+        normalize(value.distribution);
+        return true;
+    }
+
+    /**
+     * Sum (or difference) of two distributions. Distribution adds (subtracts)
+     * the probabilities of every pair of bins, so the bin k of the result is
+     * a sum of a window of the left bins plus (minus) a sum of a window of
+     * the right bins. Both windows move by one bin with k, so they are kept
+     * as running sums with two cursors each (the head adds a bin, the tail
+     * removes it) and the whole result is computed in one sequential pass.
+     */
+    bool combine(const Spilled_distribution<real>& a, const Spilled_distribution<real>& b, bool subtract,
+                 Spilled_value<real>& value) const{
+        uint64_t na = a.size();
+        uint64_t nb = b.size();
+
+        // for the difference, the right bins are read backwards (bin nb - 1 - j)
+        real origin = subtract ? a.origin - b.get_to() : a.origin + b.origin;
+        if(!create(na + nb - 1, origin, value)) return false;
+
+        Spill_cursor<real> a_head(*a.file), a_tail(*a.file);
+        Spill_cursor<real> b_head(*b.file), b_tail(*b.file);
+        Spill_cursor<real> result(*value.distribution.file, true);
+        auto b_bin = [&](Spill_cursor<real>& cursor, uint64_t j) -> real{
+            return cursor[subtract ? nb - 1 - j : j];
+        };
+
+        long double a_window = 0;
+        long double b_window = 0;
+        for(uint64_t k = 0; k < na + nb - 1; k++){
+            if(k < na) a_window += a_head[k];
+            if(k >= nb) a_window -= a_tail[k - nb];
+            if(k < nb) b_window += b_bin(b_head, k);
+            if(k >= na) b_window -= b_bin(b_tail, k - na);
+            result[k] = subtract ? a_window - b_window : a_window + b_window;
+        }
+        normalize(value.distribution);
+        return true;
+    }
+
+    /**
+     * Normalizes the distribution so that the sum equals 1 (two passes,
+     * every chunk is summed separately to keep the precision).
+     */
+    static void normalize(Spilled_distribution<real>& dist){
+        Spill_cursor<real> bins(*dist.file, true);
+        real sum = 0;
+        for(uint64_t first = 0; first < dist.size(); first += SPILL_CHUNK_BINS){
+            real chunk_sum = 0;
+            uint64_t end = std::min(dist.size(), first + SPILL_CHUNK_BINS);
+            for(uint64_t i = first; i < end; i++) chunk_sum += bins[i];
+            sum += chunk_sum;
+        }
+        for(uint64_t i = 0; i < dist.size(); i++) bins[i] /= sum;
+    }
+};
+
+#endif
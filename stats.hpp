@@ -0,0 +1,107 @@
+#ifndef STATS_HPP_
+#define STATS_HPP_
+
+#include <cstddef>
+#include <string>
+#include <mutex>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+/**
+ * Instrumentation of the operators (`--stats`): every computed operator
+ * (Token::operation) is recorded with the kinds of its operands, numbers
+ * of bins, wall time and bytes allocated for bins, and the steps are
+ * printed sorted by time at the end.
+ *
+ * When the stats are off, Token::operation only checks one flag.
+ * Allocated bytes are the bins allocated by Counting_allocator (see
+ * Memory_budget::allocated_bytes), other allocations are not counted.
+ */
+
+// at most this many steps are printed (the totals include all of them)
+#define STATS_MAX_ROWS 40
+
+/**
+ * One computed operator. Bins of a number are 0.
+ */
+struct Operation_record{
+    char op;
+    bool left_is_distribution;
+    bool right_is_distribution;
+    bool result_is_distribution;
+    size_t left_bins;
+    size_t right_bins;
+    size_t result_bins;
+    double seconds;
+    size_t bytes;
+};
+
+/**
+ * Records of all threads.
+ */
+class Operation_stats{
+
+    std::vector<Operation_record> records;
+    std::mutex mutex;
+
+public:
+
+    static inline bool enabled = false;
+
+    static Operation_stats& instance(){
+        static Operation_stats stats;
+        return stats;
+    }
+
+    void record(const Operation_record& step){
+        std::lock_guard<std::mutex> lock(mutex);
+        records.push_back(step);
+    }
+
+    /**
+     * Prints the steps sorted by time (the most expensive first) and the totals.
+     */
+    void print(std::ostream& ostr){
+        std::lock_guard<std::mutex> lock(mutex);
+        std::sort(records.begin(), records.end(), [](const Operation_record& a, const Operation_record& b){
+            return a.seconds > b.seconds;
+        });
+
+        ostr << "STATS: " << records.size() << " OPERATOR STEPS (SORTED BY TIME)" << '\n';
+        ostr << std::setw(4) << "op" << std::setw(16) << "left" << std::setw(16) << "right"
+             << std::setw(16) << "result" << std::setw(14) << "time [ms]" << std::setw(16) << "allocated [B]" << '\n';
+
+        double seconds = 0;
+        size_t bytes = 0;
+        for(size_t i = 0; i < records.size(); i++){
+            const Operation_record& step = records[i];
+            seconds += step.seconds;
+            bytes += step.bytes;
+            if(i >= STATS_MAX_ROWS) continue;
+
+            ostr << std::setw(4) << step.op << operand(step.left_is_distribution, step.left_bins)
+                 << operand(step.right_is_distribution, step.right_bins)
+                 << operand(step.result_is_distribution, step.result_bins)
+                 << std::setw(14) << std::fixed << std::setprecision(3) << step.seconds * 1e3
+                 << std::setw(16) << step.bytes << std::defaultfloat << std::setprecision(6) << '\n';
+        }
+        if(records.size() > STATS_MAX_ROWS) ostr << "... " << records.size() - STATS_MAX_ROWS << " MORE STEPS" << '\n';
+
+        ostr << "TOTAL: " << records.size() << " STEPS, " << std::fixed << std::setprecision(3) << seconds * 1e3
+             << " ms, " << bytes << " B ALLOCATED" << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+
+private:
+
+    /**
+     * Column of an operand: "dist 1001" or "number".
+     */
+    static std::string operand(bool is_distribution, size_t bins){
+        std::string text = is_distribution ? "dist " + std::to_string(bins) : "number";
+        return std::string(text.size() < 16 ? 16 - text.size() : 1, ' ') + text;
+    }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SWEEP_HPP_
+#define SWEEP_HPP_
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include "session.hpp"
+#include "parallel.hpp"
+
+/**
+ * One swept leaf: its value goes from `from` to `to` (included) by `step`.
+ */
+template <typename real>
+struct Sweep_parameter{
+    size_t leaf;
+    real from;
+    real to;
+    real step;
+
+    /**
+     * Reads the parameter in the format LEAF=FROM:TO:STEP.
+     * Returns bool (success)
+     */
+    bool read(const char* text){
+        std::stringstream tmp(text);
+        char equals, colon1, colon2;
+        if(!(tmp >> leaf >> equals >> from >> colon1 >> to >> colon2 >> step)) return false;
+        if(equals != '=' || colon1 != ':' || colon2 != ':') return false;
+        return step > 0 && from <= to;
+    }
+
+    size_t num_of_points() const{
+        // small tolerance so that rounding doesn't lose the last point
+        return (size_t)((to - from) / step + 1e-9) + 1;
+    }
+};
+
+/**
+ * Returns all combinations of values of the swept leaves (the last
+ * parameter changes the fastest).
+ */
+template <typename real>
+std::vector<std::vector<Leaf_update<real>>> sweep_points(const std::vector<Sweep_parameter<real>>& parameters){
+    std::vector<std::vector<Leaf_update<real>>> points(1);
+
+    for(auto&& parameter : parameters){
+        std::vector<std::vector<Leaf_update<real>>> new_points;
+        for(auto&& point : points){
+            for(size_t i = 0; i < parameter.num_of_points(); i++){
+                new_points.push_back(point);
+                new_points.back().push_back({parameter.leaf, parameter.from + i * parameter.step});
+            }
+        }
+        points = std::move(new_points);
+    }
+    return points;
+}
+
+/**
+ * Evaluates the session in every point of the sweep and prints the results
+ * in the order of the points. The subtrees not depending on the swept
+ * leaves are evaluated only once (by the session), the points are spread
+ * across the threads.
+ * Returns bool (success), false when some swept leaf doesn't exist.
+ */
+template <typename real>
+bool sweep(Session<real>& session, const std::vector<Sweep_parameter<real>>& parameters,
+           unsigned int threads, std::ostream& ostr, int num_of_result_bins){
+
+    for(auto&& parameter : parameters){
+        if(parameter.leaf >= session.num_of_leaves()) return false;
+    }
+
+    std::vector<std::vector<Leaf_update<real>>> points = sweep_points(parameters);
+    std::vector<std::string> outputs(points.size());
+    threads = std::max(1u, std::min<unsigned int>(threads, points.size()));
+    std::vector<Session_scratch<real>> scratches(threads);
+
+    parallel_for(points.size(), threads, [&](size_t index, unsigned int thread){
+        Trace_span span("point", index);
+        std::stringstream output;
+        output << "SWEEP";
+        for(auto&& update : points[index]) output << " leaf" << update.leaf << " = " << update.value;
+        output << std::endl;
+
+        const Token<real>& result = session.evaluate_with(points[index], scratches[thread]);
+        if(result.error_occurred) output << "ERROR OCCURRED DURING COMPUTATION." << std::endl;
+        else result.print(output, num_of_result_bins);
+        outputs[index] = output.str();
+    });
+
+    for(auto&& output : outputs) ostr << output;
+    return true;
+}
+
+#endif
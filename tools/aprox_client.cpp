@@ -0,0 +1,98 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <getopt.h>
+
+#include "../protocol.hpp"
+
+/**
+ * Client of `aprox --serve`. Sends every line of stdin as one request and
+ * prints the responses. Results are printed as by aprox, binary results
+ * (--binary) are printed as `origin bin_size` and one bin per line.
+ */
+
+#define OPTION_BINARY 256
+
+/**
+ * Prints the binary result (see Binary_result_header).
+ */
+void print_binary(const std::string& result){
+    Binary_result_header header;
+    if(result.size() < sizeof(header)) return;
+    memcpy(&header, result.data(), sizeof(header));
+    std::cout << header.origin << " " << header.bin_size << std::endl;
+
+    const char* bins = result.data() + sizeof(header);
+    for(uint64_t i = 0; i < header.count && sizeof(header) + (i + 1) * sizeof(double) <= result.size(); i++){
+        double bin;
+        memcpy(&bin, bins + i * sizeof(double), sizeof(double));
+        std::cout << bin << std::endl;
+    }
+}
+
+int main(int argc, char **argv){
+    uint32_t flags = 0;
+    int num_of_result_bins = 25;
+    double bin_size = 1;
+
+    static struct option long_options[] = {
+        {"binary", no_argument, nullptr, OPTION_BINARY},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while((c = getopt_long(argc, argv, "plb:r:", long_options, nullptr)) != -1){
+        switch(c){
+            case 'p':
+                flags |= PROTOCOL_POSTFIX;
+                break;
+            case 'l':
+                flags |= PROTOCOL_LAZY;
+                break;
+            case OPTION_BINARY:
+                flags |= PROTOCOL_BINARY;
+                break;
+            case 'b':
+                std::stringstream(optarg) >> bin_size;
+                break;
+            case 'r':
+                std::stringstream(optarg) >> num_of_result_bins;
+                break;
+            default:
+                std::cerr << "Usage: aprox_client [-p] [-l] [-b bin_size] [-r bins] [--binary] SOCKET" << std::endl;
+                return 1;
+        }
+    }
+    if(optind + 1 != argc){
+        std::cerr << "Usage: aprox_client [-p] [-l] [-b bin_size] [-r bins] [--binary] SOCKET" << std::endl;
+        return 1;
+    }
+
+    int fd = connect_socket(argv[optind]);
+    if(fd < 0){
+        std::cerr << "ERROR: UNABLE TO CONNECT TO " << argv[optind] << std::endl;
+        return 1;
+    }
+
+    std::string line;
+    std::string result;
+    uint32_t status;
+    bool success = true;
+    while(std::getline(std::cin, line)){
+        if(!send_request(fd, line, flags, num_of_result_bins, bin_size) ||
+           !read_response(fd, status, result)){
+            std::cerr << "ERROR: CONNECTION TO THE SERVER LOST." << std::endl;
+            close(fd);
+            return 1;
+        }
+
+        if(status != PROTOCOL_OK){
+            std::cout << result << std::endl;
+            success = false;
+        }
+        else if(flags & PROTOCOL_BINARY) print_binary(result);
+        else std::cout << result;
+    }
+    close(fd);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <getopt.h>
+
+#include "../protocol.hpp"
+
+/**
+ * Load generator for `aprox --serve`. Opens the given number of
+ * connections (each in its own thread), every connection sends requests
+ * one after another - the expressions are the lines of stdin taken in
+ * a cycle. Prints the throughput and percentiles of the latency.
+ */
+
+#define USAGE "Usage: aprox_loadgen [-c connections] [-n requests per connection] [-p] [-l] [-b bin_size] [-r bins] SOCKET"
+
+/**
+ * Returns the percentile (0 - 100) of sorted latencies.
+ */
+double percentile(const std::vector<double>& sorted, double percent){
+    if(sorted.empty()) return 0;
+    size_t index = (size_t)(percent / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char **argv){
+    int connections = 4;
+    int requests = 1000;
+    uint32_t flags = 0;
+    int num_of_result_bins = 25;
+    double bin_size = 1;
+
+    int c;
+    while((c = getopt(argc, argv, "c:n:plb:r:")) != -1){
+        switch(c){
+            case 'c':
+                std::stringstream(optarg) >> connections;
+                break;
+            case 'n':
+                std::stringstream(optarg) >> requests;
+                break;
+            case 'p':
+                flags |= PROTOCOL_POSTFIX;
+                break;
+            case 'l':
+                flags |= PROTOCOL_LAZY;
+                break;
+            case 'b':
+                std::stringstream(optarg) >> bin_size;
+                break;
+            case 'r':
+                std::stringstream(optarg) >> num_of_result_bins;
+                break;
+            default:
+                std::cerr << USAGE << std::endl;
+                return 1;
+        }
+    }
+    if(optind + 1 != argc || connections <= 0 || requests <= 0){
+        std::cerr << USAGE << std::endl;
+        return 1;
+    }
+    const char* path = argv[optind];
+
+    std::vector<std::string> expressions;
+    std::string line;
+    while(std::getline(std::cin, line)){
+        if(!line.empty()) expressions.push_back(line);
+    }
+    if(expressions.empty()){
+        std::cerr << "ERROR: NO EXPRESSIONS ON THE INPUT." << std::endl;
+        return 1;
+    }
+
+    // latencies (in microseconds) and failures of every connection
+    std::vector<std::vector<double>> latencies(connections);
+    std::vector<int> failures(connections, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for(int i = 0; i < connections; i++){
+        clients.emplace_back([&, i]{
+            int fd = connect_socket(path);
+            if(fd < 0){
+                failures[i] = requests;
+                return;
+            }
+            std::string result;
+            uint32_t status;
+            for(int j = 0; j < requests; j++){
+                const std::string& expression = expressions[(i + j) % expressions.size()];
+                auto sent = std::chrono::steady_clock::now();
+                if(!send_request(fd, expression, flags, num_of_result_bins, bin_size) ||
+                   !read_response(fd, status, result)){
+                    failures[i] += requests - j;
+                    break;
+                }
+                auto received = std::chrono::steady_clock::now();
+                latencies[i].push_back(std::chrono::duration<double, std::micro>(received - sent).count());
+                if(status != PROTOCOL_OK) failures[i]++;
+            }
+            close(fd);
+        });
+    }
+    for(auto&& client : clients) client.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    int failed = 0;
+    for(int i = 0; i < connections; i++){
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+        failed += failures[i];
+    }
+    std::sort(all.begin(), all.end());
+
+    std::cout << "requests:    " << all.size() << " (" << failed << " failed)" << std::endl;
+    std::cout << "connections: " << connections << std::endl;
+    std::cout << "time:        " << seconds << " s" << std::endl;
+    std::cout << "throughput:  " << all.size() / seconds << " requests/s" << std::endl;
+    std::cout << "latency p50: " << percentile(all, 50) << " us" << std::endl;
+    std::cout << "latency p90: " << percentile(all, 90) << " us" << std::endl;
+    std::cout << "latency p99: " << percentile(all, 99) << " us" << std::endl;
+    std::cout << "latency max: " << (all.empty() ? 0 : all.back()) << " us" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
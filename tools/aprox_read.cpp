@@ -0,0 +1,61 @@
+#include <iostream>
+
+#include "../result_format.hpp"
+
+/**
+ * Reads a file written with `aprox --format=bin` (mmap, no copying) and
+ * prints one line per result: line number, origin, bin_size, number of
+ * bins and the mean, or ERROR for failed results.
+ */
+
+/**
+ * Returns the mean of the result stored in the bins.
+ */
+template <typename real>
+double mean(const Result_record_header* header){
+    const real* bins = Result_file::bins<real>(header);
+    double sum = 0;
+    double weights = 0;
+    for(uint64_t i = 0; i < header->count; i++){
+        sum += bins[i] * (header->origin + i * header->bin_size);
+        weights += bins[i];
+    }
+    return weights == 0 ? 0 : sum / weights;
+}
+
+int main(int argc, char **argv){
+    if(argc != 2){
+        std::cerr << "Usage: aprox_read FILE" << std::endl;
+        return 1;
+    }
+
+    Result_file file;
+    if(!file.open(argv[1])){
+        std::cerr << "ERROR: UNABLE TO OPEN THE INPUT FILE " << argv[1] << std::endl;
+        return 1;
+    }
+
+    const Result_record_header* header;
+    while((header = file.next()) != nullptr){
+        std::cout << "LINE " << header->line << " ";
+        if(header->status != RESULT_OK){
+            std::cout << "ERROR" << '\n';
+            continue;
+        }
+
+        double result_mean;
+        switch(header->real_type){
+            case RESULT_REAL_FLOAT: result_mean = mean<float>(header); break;
+            case RESULT_REAL_DOUBLE: result_mean = mean<double>(header); break;
+            default: result_mean = mean<long double>(header); break;
+        }
+        std::cout << "origin " << header->origin << " bin_size " << header->bin_size
+                  << " bins " << header->count << " mean " << result_mean << '\n';
+    }
+    if(!file.at_end()){
+        std::cout << std::flush;
+        std::cerr << "ERROR: INVALID OR TRUNCATED RECORD IN " << argv[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}
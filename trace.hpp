@@ -0,0 +1,153 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Timeline of the evaluation (`--trace FILE`) in the Chrome trace-event
+ * format (JSON), which can be opened in chrome://tracing or Perfetto.
+ *
+ * Spans are complete events ("ph":"X") of the thread that created them:
+ * parsing, every operator (Token::operation), leaf construction,
+ * normalization, output formatting and the work of the threads (batch
+ * lines, sweep points and waiting for work). Spans with distributions
+ * have the number of bins as an argument.
+ *
+ * When tracing is off, a Trace_span only checks one flag.
+ */
+
+// category of the spans (the "cat" field)
+#define TRACE_CATEGORY "aprox"
+
+/**
+ * One finished span.
+ */
+struct Trace_event{
+    std::string name;
+    int thread;
+    double start; // microseconds from the start of the trace
+    double duration;
+    long long bins; // -1 = no bins
+};
+
+/**
+ * Events of all threads, written to the file at the end.
+ */
+class Trace{
+
+    std::vector<Trace_event> events;
+    std::vector<std::pair<int, std::string>> thread_names;
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<int> next_thread{0};
+
+public:
+
+    static inline bool enabled = false;
+
+    static Trace& instance(){
+        static Trace trace;
+        return trace;
+    }
+
+    /**
+     * Small number of the calling thread (tid of its events).
+     */
+    int thread(){
+        thread_local int id = next_thread++;
+        return id;
+    }
+
+    /**
+     * Names the calling thread in the trace viewer.
+     */
+    void name_thread(const std::string& name){
+        if(!enabled) return;
+        int id = thread();
+        std::lock_guard<std::mutex> lock(mutex);
+        thread_names.emplace_back(id, name + " " + std::to_string(id));
+    }
+
+    double now() const{
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void add(Trace_event&& event){
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(std::move(event));
+    }
+
+    /**
+     * Writes the trace into the file. Returns bool (success)
+     */
+    bool write(const char* path){
+        std::lock_guard<std::mutex> lock(mutex);
+        FILE* file = fopen(path, "w");
+        if(file == nullptr) return false;
+
+        fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        for(auto&& name : thread_names){
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", name.first, name.second.c_str());
+            first = false;
+        }
+        for(auto&& event : events){
+            fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"" TRACE_CATEGORY "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f", first ? "" : ",\n", event.name.c_str(), event.thread,
+                    event.start, event.duration);
+            if(event.bins >= 0) fprintf(file, ",\"args\":{\"bins\":%lld}", event.bins);
+            fprintf(file, "}");
+            first = false;
+        }
+        fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        return fclose(file) == 0;
+    }
+};
+
+/**
+ * Span from the construction to the destruction (RAII).
+ */
+class Trace_span{
+
+    const char* name;
+    std::string owned_name; // used when the name is built at runtime
+    double start;
+    long long bins;
+
+public:
+
+    Trace_span(const char* name) : name(name), start(0), bins(-1){
+        if(Trace::enabled) start = Trace::instance().now();
+    }
+
+    Trace_span(const char* prefix, long long number) : name(nullptr), start(0), bins(-1){
+        if(!Trace::enabled) return;
+        owned_name = std::string(prefix) + " " + std::to_string(number);
+        start = Trace::instance().now();
+    }
+
+    Trace_span(const Trace_span&) = delete;
+    Trace_span& operator=(const Trace_span&) = delete;
+
+    /**
+     * Sets the number of bins (argument of the span).
+     */
+    void set_bins(long long count){
+        bins = count;
+    }
+
+    ~Trace_span(){
+        if(!Trace::enabled) return;
+        Trace& trace = Trace::instance();
+        trace.add({name != nullptr ? std::string(name) : std::move(owned_name), trace.thread(),
+                   start, trace.now() - start, bins});
+    }
+};
+
+#endif